@@ -0,0 +1,1054 @@
+// Measures the overhead of Raman pipelines compared to handwritten loops and,
+// when available, to their C++20 std::views equivalents.
+//
+// Usage: benchmarks [size ...]
+// Every benchmark runs once per size (default: 1000 and 1000000 elements),
+// and reports nanoseconds per input element for each implementation, along
+// with Raman's overhead relative to the handwritten loop.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__has_include)
+#  if __has_include(<version>)
+#    include <version>
+#  endif
+#endif
+#ifdef __cpp_lib_ranges
+#  include <ranges>
+#  define RAMAN_BENCHMARK_RANGES
+#endif
+
+#include "raman.hpp"
+
+using std::map;
+using std::string;
+using std::unordered_set;
+using std::vector;
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  // Keeps the compiler from optimizing away computations whose results are
+  // otherwise unused.
+  template <typename T>
+  void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+  }
+
+  // Runs `fn` repeatedly for at least 100ms, and returns the average time in
+  // nanoseconds per element.
+  template <typename Fn>
+  double NanosPerElement(std::size_t elements, Fn& fn) {
+    fn();  // Warm-up.
+    std::size_t iterations = 1;
+    while (true) {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < iterations; ++i) {
+        fn();
+      }
+      auto elapsed = std::chrono::duration<double, std::nano>(
+          Clock::now() - start).count();
+      if (elapsed >= 1e8) {
+        return elapsed / iterations / std::max<std::size_t>(elements, 1);
+      }
+      iterations *= 2;
+    }
+  }
+
+  // Marks a benchmark as having no std::views equivalent.
+  struct NoRanges {};
+
+  template <typename Fn>
+  double MaybeNanosPerElement(std::size_t elements, Fn& fn) {
+    return NanosPerElement(elements, fn);
+  }
+  double MaybeNanosPerElement(std::size_t, NoRanges&) {
+    return -1;
+  }
+
+  void PrintHeader() {
+    std::printf("%-36s %9s %10s %10s %10s %9s\n", "benchmark (ns/element)",
+                "size", "raman", "loop", "views", "overhead");
+  }
+
+  template <typename Raman, typename Loop, typename Ranges = NoRanges>
+  void Report(const char* name, std::size_t size, Raman raman, Loop loop,
+              Ranges ranges = NoRanges()) {
+    double raman_ns = NanosPerElement(size, raman);
+    double loop_ns = NanosPerElement(size, loop);
+    double ranges_ns = MaybeNanosPerElement(size, ranges);
+    char ranges_str[16] = "n/a";
+    if (ranges_ns >= 0) {
+      std::snprintf(ranges_str, sizeof(ranges_str), "%.2f", ranges_ns);
+    }
+    std::printf("%-36s %9zu %10.2f %10.2f %10s %8.2fx\n", name, size,
+                raman_ns, loop_ns, ranges_str, raman_ns / loop_ns);
+  }
+
+  vector<int> RandomInts(std::size_t size) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> distribution(0, 1000000);
+    vector<int> out(size);
+    for (auto& i : out) {
+      i = distribution(rng);
+    }
+    return out;
+  }
+
+  vector<string> RandomStrings(std::size_t size) {
+    vector<string> out;
+    out.reserve(size);
+    for (int i : RandomInts(size)) {
+      out.push_back("string-" + std::to_string(i));
+    }
+    return out;
+  }
+
+  bool IsEven(int i) { return i % 2 == 0; }
+  bool IsShort(const string& s) { return s.size() < 13; }
+
+  void BenchmarkInts(std::size_t n) {
+    const vector<int> in = RandomInts(n);
+
+    Report("int: Where", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in).Where(IsEven)) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (int i : in) if (IsEven(i)) sum += i;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in | std::views::filter(IsEven)) sum += i;
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("int: Transform", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in).Transform([](int i) { return i * 3; })) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (int i : in) sum += i * 3;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in | std::views::transform([](int i) { return i * 3; })) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("int: Where+Transform", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in)
+                         .Where(IsEven)
+                         .Transform([](int i) { return i * 3; })) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (int i : in) if (IsEven(i)) sum += i * 3;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in | std::views::filter(IsEven)
+                          | std::views::transform([](int i) { return i * 3; })) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("int: Reverse", n,
+        [&]() {
+          long sum = 0;
+          long k = 0;
+          for (int i : raman::From(in).Reverse()) sum += i * ++k;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          long k = 0;
+          for (auto it = in.rbegin(); it != in.rend(); ++it) sum += *it * ++k;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          long k = 0;
+          for (int i : in | std::views::reverse) sum += i * ++k;
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("int: AddressOf+Dereference", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in).AddressOf().Dereference()) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (const int& i : in) sum += *&i;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in
+                 | std::views::transform([](const int& i) { return &i; })
+                 | std::views::transform([](const int* i) { return *i; })) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("int: Sort", n,
+        [&]() {
+          long sum = 0;
+          long k = 0;
+          for (int i : raman::From(in).Sort()) sum += i * ++k;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          vector<const int*> sorted;
+          sorted.reserve(in.size());
+          for (const int& i : in) sorted.push_back(&i);
+          std::sort(sorted.begin(), sorted.end(),
+                    [](const int* a, const int* b) { return *a < *b; });
+          long sum = 0;
+          long k = 0;
+          for (const int* i : sorted) sum += *i * ++k;
+          DoNotOptimize(sum);
+        });
+
+    Report("int: Sort+Unique+Reverse", n,
+        [&]() {
+          long sum = 0;
+          long k = 0;
+          for (int i : raman::From(in).Sort().Unique().Reverse()) {
+            sum += i * ++k;
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          vector<const int*> sorted;
+          sorted.reserve(in.size());
+          for (const int& i : in) sorted.push_back(&i);
+          std::sort(sorted.begin(), sorted.end(),
+                    [](const int* a, const int* b) { return *a < *b; });
+          sorted.erase(std::unique(sorted.begin(), sorted.end(),
+                                   [](const int* a, const int* b) {
+                                     return *a == *b;
+                                   }),
+                       sorted.end());
+          long sum = 0;
+          long k = 0;
+          for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+            sum += **it * ++k;
+          }
+          DoNotOptimize(sum);
+        });
+
+    Report("int: Where -> vector", n,
+        [&]() {
+          vector<int> out = raman::From(in).Where(IsEven);
+          DoNotOptimize(out.data());
+        },
+        [&]() {
+          vector<int> out;
+          for (int i : in) if (IsEven(i)) out.push_back(i);
+          DoNotOptimize(out.data());
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          auto view = in | std::views::filter(IsEven);
+          vector<int> out(view.begin(), view.end());
+          DoNotOptimize(out.data());
+        }
+#endif
+        );
+
+    Report("int: Partition", n,
+        [&]() {
+          auto parts = raman::From(in).Partition(IsEven);
+          DoNotOptimize(parts.first.data());
+          DoNotOptimize(parts.second.data());
+        },
+        [&]() {
+          vector<int> evens;
+          vector<int> odds;
+          for (int i : in) (IsEven(i) ? evens : odds).push_back(i);
+          DoNotOptimize(evens.data());
+          DoNotOptimize(odds.data());
+        });
+
+    Report("int: Aggregate (4 results)", n,
+        [&]() {
+          auto stats = raman::From(in).Where(IsEven).Aggregate(
+              raman::Count(), raman::Sum<long>(), raman::Min(), raman::Max());
+          DoNotOptimize(stats);
+        },
+        [&]() {
+          std::size_t count = 0;
+          long sum = 0;
+          int min = std::numeric_limits<int>::max();
+          int max = std::numeric_limits<int>::min();
+          for (int i : in) {
+            if (!IsEven(i)) continue;
+            ++count;
+            sum += i;
+            min = std::min(min, i);
+            max = std::max(max, i);
+          }
+          DoNotOptimize(count);
+          DoNotOptimize(sum);
+          DoNotOptimize(min);
+          DoNotOptimize(max);
+        });
+
+    Report("int: -> unordered_set", n,
+        [&]() {
+          unordered_set<int> out = raman::From(in);
+          DoNotOptimize(out.size());
+        },
+        [&]() {
+          unordered_set<int> out;
+          for (int i : in) out.insert(i);
+          DoNotOptimize(out.size());
+        });
+
+    // Searches the whole vector, as no element matches.
+    Report("int: Contains", n,
+        [&]() {
+          DoNotOptimize(raman::From(in).Contains(-1));
+        },
+        [&]() {
+          bool found = false;
+          for (int i : in) {
+            if (i == -1) {
+              found = true;
+              break;
+            }
+          }
+          DoNotOptimize(found);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          DoNotOptimize(std::ranges::find(in, -1) != in.end());
+        }
+#endif
+        );
+
+    Report("int: Any", n,
+        [&]() {
+          DoNotOptimize(raman::From(in).Any([](int i) { return i < 0; }));
+        },
+        [&]() {
+          bool found = false;
+          for (int i : in) {
+            if (i < 0) {
+              found = true;
+              break;
+            }
+          }
+          DoNotOptimize(found);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          DoNotOptimize(
+              std::ranges::any_of(in, [](int i) { return i < 0; }));
+        }
+#endif
+        );
+  }
+
+  void BenchmarkStrings(std::size_t n) {
+    const vector<string> in = RandomStrings(n);
+
+    Report("string: Where", n,
+        [&]() {
+          std::size_t sum = 0;
+          for (const string& s : raman::From(in).Where(IsShort)) {
+            sum += s.size();
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          std::size_t sum = 0;
+          for (const string& s : in) if (IsShort(s)) sum += s.size();
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          std::size_t sum = 0;
+          for (const string& s : in | std::views::filter(IsShort)) {
+            sum += s.size();
+          }
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("string: Sort+Unique+Reverse", n,
+        [&]() {
+          std::size_t sum = 0;
+          for (const string& s : raman::From(in).Sort().Unique().Reverse()) {
+            sum += s.size();
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          vector<const string*> sorted;
+          sorted.reserve(in.size());
+          for (const string& s : in) sorted.push_back(&s);
+          std::sort(sorted.begin(), sorted.end(),
+                    [](const string* a, const string* b) { return *a < *b; });
+          sorted.erase(std::unique(sorted.begin(), sorted.end(),
+                                   [](const string* a, const string* b) {
+                                     return *a == *b;
+                                   }),
+                       sorted.end());
+          std::size_t sum = 0;
+          for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+            sum += (*it)->size();
+          }
+          DoNotOptimize(sum);
+        });
+
+    Report("string: -> vector", n,
+        [&]() {
+          vector<string> out = raman::From(in);
+          DoNotOptimize(out.data());
+        },
+        [&]() {
+          vector<string> out;
+          for (const string& s : in) out.push_back(s);
+          DoNotOptimize(out.data());
+        });
+  }
+
+  void BenchmarkMaps(std::size_t n) {
+    map<int, int> in;
+    for (int i : RandomInts(n)) {
+      in[i] = i / 2;
+    }
+
+    Report("map: Keys", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in).Keys()) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (const auto& entry : in) sum += entry.first;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in | std::views::keys) sum += i;
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("map: Values", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in).Values()) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (const auto& entry : in) sum += entry.second;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in | std::views::values) sum += i;
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+
+    Report("vector -> map", n,
+        [&]() {
+          vector<std::pair<const int, int>> pairs(in.begin(), in.end());
+          map<int, int> out = raman::From(pairs);
+          DoNotOptimize(out.size());
+        },
+        [&]() {
+          vector<std::pair<const int, int>> pairs(in.begin(), in.end());
+          map<int, int> out;
+          for (const auto& entry : pairs) out.insert(out.end(), entry);
+          DoNotOptimize(out.size());
+        });
+  }
+
+  void BenchmarkPointers(std::size_t n) {
+    vector<int> data = RandomInts(n);
+    vector<int*> in;
+    for (int& i : data) {
+      in.push_back(&i);
+    }
+
+    Report("int*: Dereference", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in).Dereference()) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (int* i : in) sum += *i;
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : in | std::views::transform([](int* i) { return *i; })) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+  }
+  void BenchmarkMerge(std::size_t n) {
+    const std::size_t kShards = 8;
+    vector<vector<int>> shards(kShards);
+    for (std::size_t i = 0; i < kShards; ++i) {
+      shards[i] = RandomInts(n / kShards + (i < n % kShards ? 1 : 0));
+      std::sort(shards[i].begin(), shards[i].end());
+    }
+
+    Report("int: MergeAll (8 shards)", n,
+        [&]() {
+          long sum = 0;
+          long k = 0;
+          for (int i : raman::MergeAll(shards)) sum += i * ++k;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          using Head = std::pair<int, std::size_t>;
+          std::priority_queue<Head, vector<Head>, std::greater<Head>> heads;
+          vector<std::size_t> positions(kShards, 0);
+          for (std::size_t i = 0; i < kShards; ++i) {
+            if (!shards[i].empty()) heads.push({shards[i][0], i});
+          }
+          long sum = 0;
+          long k = 0;
+          while (!heads.empty()) {
+            Head head = heads.top();
+            heads.pop();
+            sum += head.first * ++k;
+            std::size_t& position = positions[head.second];
+            if (++position < shards[head.second].size()) {
+              heads.push({shards[head.second][position], head.second});
+            }
+          }
+          DoNotOptimize(sum);
+        });
+
+    // What MergeAll() replaces: sorting the concatenated shards.
+    Report("int: Sort of all shards", n,
+        [&]() {
+          long sum = 0;
+          long k = 0;
+          vector<int> all;
+          for (const auto& shard : shards) {
+            all.insert(all.end(), shard.begin(), shard.end());
+          }
+          for (int i : raman::From(all).Sort()) sum += i * ++k;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          vector<int> all;
+          for (const auto& shard : shards) {
+            all.insert(all.end(), shard.begin(), shard.end());
+          }
+          std::sort(all.begin(), all.end());
+          long sum = 0;
+          long k = 0;
+          for (int i : all) sum += i * ++k;
+          DoNotOptimize(sum);
+        });
+  }
+  void BenchmarkSetOperations(std::size_t n) {
+    vector<int> large = RandomInts(n);
+    std::sort(large.begin(), large.end());
+    vector<int> small = RandomInts(std::max<std::size_t>(n / 1000, 1));
+    std::sort(small.begin(), small.end());
+
+    // A short posting list against a long one.
+    Report("int: Intersect (1:1000)", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(small).Intersect(large)) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          vector<int> out;
+          std::set_intersection(small.begin(), small.end(), large.begin(),
+                                large.end(), std::back_inserter(out));
+          long sum = 0;
+          for (int i : out) sum += i;
+          DoNotOptimize(sum);
+        });
+
+    Report("int: Except", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(large).Except(small)) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          vector<int> out;
+          std::set_difference(large.begin(), large.end(), small.begin(),
+                              small.end(), std::back_inserter(out));
+          long sum = 0;
+          for (int i : out) sum += i;
+          DoNotOptimize(sum);
+        });
+  }
+
+  // Struct-of-arrays columns, walked together.
+  void BenchmarkZip(std::size_t n) {
+    const vector<int> prices = RandomInts(n);
+    const vector<int> quantities = RandomInts(n);
+
+    Report("int: Zip (dot product)", n,
+        [&]() {
+          long sum = 0;
+          for (auto row : raman::From(prices).Zip(quantities)) {
+            sum += long{std::get<0>(row)} * std::get<1>(row);
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (std::size_t i = 0; i < prices.size(); ++i) {
+            sum += long{prices[i]} * quantities[i];
+          }
+          DoNotOptimize(sum);
+        });
+
+    Report("int: Enumerate", n,
+        [&]() {
+          std::size_t sum = 0;
+          for (auto entry : raman::From(prices).Enumerate()) {
+            if (IsEven(entry.second)) sum += entry.first;
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          std::size_t sum = 0;
+          for (std::size_t i = 0; i < prices.size(); ++i) {
+            if (IsEven(prices[i])) sum += i;
+          }
+          DoNotOptimize(sum);
+        });
+  }
+
+  // Nested collections of 8 elements, between empty ones.
+  void BenchmarkFlatten(std::size_t n) {
+    vector<vector<int>> nested;
+    const vector<int> in = RandomInts(n);
+    for (std::size_t i = 0; i < n; i += 8) {
+      nested.emplace_back();
+      nested.emplace_back(in.begin() + i, in.begin() + std::min(i + 8, n));
+      nested.emplace_back();
+    }
+
+    Report("int: Flatten", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(nested).Flatten()) sum += i;
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (const auto& inner : nested) {
+            for (int i : inner) sum += i;
+          }
+          DoNotOptimize(sum);
+        }
+#ifdef RAMAN_BENCHMARK_RANGES
+        , [&]() {
+          long sum = 0;
+          for (int i : nested | std::views::join) sum += i;
+          DoNotOptimize(sum);
+        }
+#endif
+        );
+  }
+
+  // Rolling computations over a time series.
+  void BenchmarkWindows(std::size_t n) {
+    const vector<int> samples = RandomInts(n);
+
+    Report("int: Pairwise (deltas)", n,
+        [&]() {
+          long sum = 0;
+          for (auto pair : raman::From(samples).Pairwise()) {
+            sum += std::abs(std::get<1>(pair) - std::get<0>(pair));
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (std::size_t i = 1; i < samples.size(); ++i) {
+            sum += std::abs(samples[i] - samples[i - 1]);
+          }
+          DoNotOptimize(sum);
+        });
+
+    Report("int: Window(4) (maxima)", n,
+        [&]() {
+          long sum = 0;
+          for (auto window : raman::From(samples).Window(4)) {
+            sum += *std::max_element(window.begin(), window.end());
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (std::size_t i = 3; i < samples.size(); ++i) {
+            sum += *std::max_element(&samples[i - 3], &samples[i] + 1);
+          }
+          DoNotOptimize(sum);
+        });
+  }
+
+  // Per-window counts and maxima over a stream of timestamps.
+  void BenchmarkWindowAggregates(std::size_t n) {
+    vector<int> times = RandomInts(n);
+    std::sort(times.begin(), times.end());
+    auto identity = [](int i) { return i; };
+
+    Report("int: TumblingWindow (count, max)", n,
+        [&]() {
+          long sum = 0;
+          for (const auto& window : raman::From(times).TumblingWindow(
+                   identity, 1000, raman::Count(), raman::Max())) {
+            sum += std::get<0>(window.second) + std::get<1>(window.second);
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          std::size_t count = 0;
+          int max = 0;
+          int window = times.empty() ? 0 : times[0] / 1000;
+          for (int time : times) {
+            if (time / 1000 != window) {
+              sum += count + max;
+              window = time / 1000;
+              count = 0;
+            }
+            ++count;
+            max = std::max(max, time);
+          }
+          sum += count + max;
+          DoNotOptimize(sum);
+        });
+
+    Report("int: SlidingWindow (count, 4 panes)", n,
+        [&]() {
+          long sum = 0;
+          for (const auto& window : raman::From(times).SlidingWindow(
+                   identity, 4000, 1000, raman::Count())) {
+            sum += std::get<0>(window.second);
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          // Counts per pane, then sums of 4 consecutive ones.
+          vector<std::size_t> panes(1000001 / 1000 + 1);
+          for (int time : times) ++panes[time / 1000];
+          long sum = 0;
+          for (std::size_t i = 0; i < panes.size() + 3; ++i) {
+            for (std::size_t j = i < 3 ? 0 : i - 3;
+                 j <= i && j < panes.size(); ++j) {
+              sum += panes[j];
+            }
+          }
+          DoNotOptimize(sum);
+        });
+  }
+
+  // Export of numbers as text, to an in-memory stream.
+  void BenchmarkWriteTo(std::size_t n) {
+    vector<int> ints = RandomInts(n);
+    vector<double> doubles(ints.begin(), ints.end());
+    for (double& d : doubles) d /= 7;
+
+    Report("int: WriteTo", n,
+        [&]() {
+          std::ostringstream output;
+          raman::From(ints).WriteTo(output);
+          DoNotOptimize(output.tellp());
+        },
+        [&]() {
+          std::ostringstream output;
+          for (int i : ints) output << i << '\n';
+          DoNotOptimize(output.tellp());
+        });
+
+    Report("double: WriteTo", n,
+        [&]() {
+          std::ostringstream output;
+          raman::From(doubles).WriteTo(output);
+          DoNotOptimize(output.tellp());
+        },
+        [&]() {
+          std::ostringstream output;
+          output.precision(std::numeric_limits<double>::max_digits10);
+          for (double d : doubles) output << d << '\n';
+          DoNotOptimize(output.tellp());
+        });
+  }
+
+#ifdef RAMAN_HAS_CHARCONV
+  // Parsing of (int, name, double) rows, against splitting lines into
+  // strings and converting those.
+  void BenchmarkFromCsv(std::size_t n) {
+    string text;
+    for (int i : RandomInts(n)) {
+      text += std::to_string(i) + ",name" + std::to_string(i % 100) + "," +
+              std::to_string(i / 7.0) + "\n";
+    }
+
+    Report("csv: FromCsv", n,
+        [&]() {
+          double sum = 0;
+          for (const auto& row :
+               raman::FromCsv<int, std::string_view, double>(text)) {
+            sum += std::get<0>(row) + std::get<1>(row).size() +
+                   std::get<2>(row);
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          double sum = 0;
+          std::istringstream stream(text);
+          string line;
+          while (std::getline(stream, line)) {
+            vector<string> fields;
+            std::size_t begin = 0;
+            while (true) {
+              std::size_t end = line.find(',', begin);
+              fields.push_back(line.substr(begin, end - begin));
+              if (end == string::npos) break;
+              begin = end + 1;
+            }
+            sum += std::stoi(fields[0]) + fields[1].size() +
+                   std::stod(fields[2]);
+          }
+          DoNotOptimize(sum);
+        });
+  }
+#endif
+
+  // A filter deciding for blocks with branch-free code, against a per
+  // element branch, which mispredicts on random input.
+  void BenchmarkWhereBatch(std::size_t n) {
+    const vector<int> in = RandomInts(n);
+    auto evens = [](const int* begin, const int* end) {
+      std::uint64_t mask = 0;
+      for (const int* it = begin; it != end; ++it) {
+        mask |= std::uint64_t(*it % 2 == 0) << (it - begin);
+      }
+      return mask;
+    };
+
+    Report("int: WhereBatch", n,
+        [&]() {
+          long sum = 0;
+          for (int i : raman::From(in.data(), in.data() + in.size())
+                           .WhereBatch(evens)) {
+            sum += i;
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (int i : in) if (IsEven(i)) sum += i;
+          DoNotOptimize(sum);
+        });
+  }
+
+  // Offsets of records from their sizes.
+  void BenchmarkScan(std::size_t n) {
+    vector<std::size_t> sizes(n);
+    for (std::size_t i = 0; i < n; ++i) sizes[i] = i % 13;
+
+    Report("size_t: Scan -> vector", n,
+        [&]() {
+          vector<std::size_t> offsets =
+              raman::From(sizes).Scan(std::size_t(0));
+          DoNotOptimize(offsets.back());
+        },
+        [&]() {
+          vector<std::size_t> offsets;
+          offsets.reserve(sizes.size());
+          std::size_t offset = 0;
+          for (std::size_t size : sizes) {
+            offsets.push_back(offset);
+            offset += size;
+          }
+          DoNotOptimize(offsets.back());
+        });
+
+    Report("size_t: ParallelScan", n,
+        [&]() {
+          vector<std::size_t> offsets =
+              raman::From(sizes).ParallelScan(std::size_t(0));
+          DoNotOptimize(offsets.back());
+        },
+        [&]() {
+          vector<std::size_t> offsets(sizes.size());
+          std::size_t offset = 0;
+          for (std::size_t i = 0; i < sizes.size(); ++i) {
+            offsets[i] = offset;
+            offset += sizes[i];
+          }
+          DoNotOptimize(offsets.back());
+        });
+  }
+
+  // Samples of 100 elements, against shuffling a copy of the input.
+  void BenchmarkSample(std::size_t n) {
+    const vector<int> in = RandomInts(n);
+    std::mt19937 rng(1);
+    auto shuffled = [&]() {
+      vector<int> copy = in;
+      std::shuffle(copy.begin(), copy.end(), rng);
+      copy.resize(std::min<std::size_t>(copy.size(), 100));
+      DoNotOptimize(copy.data());
+    };
+
+    Report("int: Sample (random access)", n,
+        [&]() { DoNotOptimize(raman::From(in).Sample(100, rng).data()); },
+        shuffled);
+
+    Report("int: Sample (sequential)", n,
+        [&]() {
+          DoNotOptimize(raman::From(in)
+                            .Transform([](int i) { return i; })
+                            .Sample(100, rng)
+                            .data());
+        },
+        shuffled);
+  }
+
+  // 20 pages of 100 sorted even elements, against sorting again and
+  // skipping the pages before for each page.
+  void BenchmarkCursor(std::size_t n) {
+    const vector<int> in = RandomInts(n);
+    const std::size_t kPage = 100;
+
+    Report("int: Cursor (20 pages)", n,
+        [&]() {
+          auto cursor = raman::From(in).Where(IsEven).Sort().Cursor();
+          long sum = 0;
+          for (int page = 0; page < 20; ++page) {
+            for (int i : cursor.Next(kPage)) sum += i;
+          }
+          DoNotOptimize(sum);
+        },
+        [&]() {
+          long sum = 0;
+          for (std::size_t page = 0; page < 20; ++page) {
+            vector<int> evens;
+            for (int i : in) if (IsEven(i)) evens.push_back(i);
+            std::sort(evens.begin(), evens.end());
+            for (std::size_t i = page * kPage;
+                 i < std::min(evens.size(), (page + 1) * kPage); ++i) {
+              sum += evens[i];
+            }
+          }
+          DoNotOptimize(sum);
+        });
+  }
+}
+
+int main(int argc, char** argv) {
+  vector<std::size_t> sizes;
+  for (int i = 1; i < argc; ++i) {
+    sizes.push_back(std::strtoul(argv[i], nullptr, 10));
+  }
+  if (sizes.empty()) {
+    sizes = {1000, 1000000};
+  }
+
+  PrintHeader();
+  for (std::size_t size : sizes) {
+    BenchmarkInts(size);
+    BenchmarkStrings(size);
+    BenchmarkMaps(size);
+    BenchmarkPointers(size);
+    BenchmarkMerge(size);
+    BenchmarkSetOperations(size);
+    BenchmarkZip(size);
+    BenchmarkFlatten(size);
+    BenchmarkWindows(size);
+    BenchmarkWindowAggregates(size);
+    BenchmarkWriteTo(size);
+#ifdef RAMAN_HAS_CHARCONV
+    BenchmarkFromCsv(size);
+#endif
+    BenchmarkWhereBatch(size);
+    BenchmarkScan(size);
+    BenchmarkSample(size);
+    BenchmarkCursor(size);
+  }
+  return 0;
+}
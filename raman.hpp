@@ -22,26 +22,123 @@
  * Iterate over entries larger than 2:
  * vector<int> input = ...;
  * for (int i : raman::From(input).Where([](int j) { return j > 2; })) { ... }
+ * or decide for up to 64 elements at a time, returning a mask of those to keep:
+ * for (Key k : raman::From(keys).WhereBatch(ContainsAll)) { ... }
+ * Take the third page of 10 sorted results (slicing random-access ranges is
+ * O(1)):
+ * vector<int> page = raman::From(input).Sort().Skip(20).Take(10);
+ * Queries like Any(), All(), Contains() and First() stop at the first element
+ * deciding their result:
+ * bool has_negative = raman::From(input).Any([](int j) { return j < 0; });
+ * Split elements in a single pass:
+ * auto [small, large] = raman::From(input).Partition(IsSmall);
+ * or sample it, in O(k) memory:
+ * vector<int> sample = raman::From(input).Sample(100, rng);
+ * or compute several results in a single pass:
+ * auto [count, sum, max] = raman::From(input).Where(IsValid).Aggregate(
+ *     raman::Count(), raman::Sum(), raman::Max());
+ * also per time window, over a stream ordered by time:
+ * for (auto& [start, counts] : raman::From(events).TumblingWindow(
+ *          TimeOf, 1000, raman::Count())) { ... }
  *
  * (2) Sort, Unique, Reverse
  * Iterate over unique items in reverse-sorted order:
  * for (string s : raman::From(GetStrings()).Sort().Unique().Reverse()) { ... }
+ * Sorting happens lazily, once iteration starts. Adjacent stages are fused
+ * where possible: Sort().Reverse() sorts in descending order, Where().Where()
+ * and Transform().Transform() run as single stages.
  *
  * (3) Conversion
  * Convert any container to any container:
  * vector<int> list_to_vector = raman::From(l);  // l is of type list<int>
+ * Walk parallel containers together, without copying their elements:
+ * for (auto [name, age] : raman::From(names).Zip(ages)) { ... }
+ * for (auto [index, name] : raman::From(names).Enumerate()) { ... }
+ * Walk nested or separate containers as one, without copying them:
+ * for (int i : raman::From(vector_of_vectors).Flatten()) { ... }
+ * for (int i : raman::Concat(head, tail)) { ... }
+ * Compute over consecutive elements, without copying them:
+ * vector<int> deltas = raman::From(samples).Pairwise().Transform(Delta);
+ * vector<int> maxima = raman::From(samples).Window(10).Transform(Max);
+ * Compute running results, like offsets from sizes, lazily or in parallel:
+ * vector<size_t> offsets = raman::From(sizes).Scan(size_t(0));
+ * vector<size_t> offsets = raman::From(sizes).ParallelScan(size_t(0));
+ *
+ * (4) Streaming
+ * Single-pass and forward-only iterators may be used as well. Stages which
+ * must walk backwards (like Reverse()) buffer such ranges first:
+ * istream_iterator<int> begin(stream), end;
+ * vector<int> evens = raman::From(begin, end).Where(IsEven);
+ * and written out as text, much faster than with operator<< per element:
+ * raman::From(evens).WriteTo(output_file);
+ * From C++17 on, CSV text may be parsed into typed rows without copying it:
+ * for (auto [id, name] : raman::FromCsv<int, string_view>(text)) { ... }
+ *
+ * (5) Producers
+ * Sequences may be computed lazily instead of being stored in a container:
+ * for (int i : raman::Iota(0, 1000000).Where(IsPrime)) { ... }
+ * for (int i : raman::Generate(NextRandom, 100)) { ... }
+ * Results may be taken a page at a time, resuming where the last page ended:
+ * auto cursor = raman::From(items).Where(IsVisible).Sort().Cursor();
+ * vector<Item> page = cursor.Next(20);
+ * In C++20, coroutines returning raman::Generator<T> may be passed to From().
+ * Sorted ranges may be merged lazily, without sorting them again:
+ * for (int i : raman::Merge(sorted1, sorted2)) { ... }
+ * for (int i : raman::MergeAll(vector_of_sorted_vectors)) { ... }
+ * and combined as sets, skipping ahead when one side is much shorter:
+ * for (int id : raman::From(sorted_ids).Intersect(allowed_ids)) { ... }
+ *
+ * (6) Compile time
+ * From C++17 on, pipelines over std::array or Iota() may be evaluated at
+ * compile time, and converted to a std::array (Sort() requires C++20):
+ * constexpr array<int, 5> kSquares =
+ *     raman::Iota(0, 5).Transform([](int i) { return i * i; });
  *
  * To enable internal asserts #define RAMAN_ENABLE_RUNTIME_ASSERT
+ * To collect per-stage statistics #define RAMAN_ENABLE_STATS (see Probe()).
  */
 
 #ifndef RAMAN_CONTAINERS_LIBRARY
 #define RAMAN_CONTAINERS_LIBRARY
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <exception>
+#include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __has_include(<coroutine>)
+#    include <coroutine>
+#    define RAMAN_HAS_COROUTINES
+#  endif
+#endif
+
+#if defined(__has_include) && __cplusplus >= 201703L
+#  if __has_include(<charconv>)
+#    include <charconv>
+#    include <string_view>
+#    ifndef __cpp_lib_to_chars
+#      include <cstdlib>
+#    endif
+#    define RAMAN_HAS_CHARCONV
+#  endif
+#endif
 
 #ifdef RAMAN_ENABLE_RUNTIME_ASSERT
 #  define RAMAN_STRINGIZE_DETAIL(x) #x
@@ -56,13 +153,143 @@
 #  define RAMAN_ASSERT(x)
 #endif
 
+#ifdef RAMAN_ENABLE_STATS
+#  if defined(__x86_64__) || defined(__i386__)
+#    include <x86intrin.h>
+#  elif defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#  include <chrono>
+#  include <cstdint>
+#  include <functional>
+#  define RAMAN_STATS(...) __VA_ARGS__
+// Statistics are only collected at runtime, but from C++20 on they don't
+// prevent pipelines from being evaluated at compile time.
+#  if defined(__cpp_lib_is_constant_evaluated) && __cpp_constexpr >= 201907L
+#    define RAMAN_STATS_CONSTEXPR constexpr
+#    define RAMAN_STATS_IS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#  else
+#    define RAMAN_STATS_CONSTEXPR
+#    define RAMAN_STATS_IS_CONSTANT_EVALUATED() false
+#  endif
+#else
+#  define RAMAN_STATS(...)
+#endif
+
 // TODO:
-// - Allow forward (i.e: non-backward) iterators
 // - Add many more RAMAN_ASSERTs
 namespace raman {
+  // Statistics of a single stage, collected when RAMAN_ENABLE_STATS is
+  // defined.
+  struct StageStats {
+    const char* name = "";
+    // Elements pulled from upstream, and passed downstream.
+    unsigned long long elements_in = 0;
+    unsigned long long elements_out = 0;
+    // Calls to the stage's predicate / transformer.
+    unsigned long long calls = 0;
+    // Cycles spent in the stage's predicate / transformer. For Probe()s,
+    // cycles spent producing elements upstream.
+    unsigned long long cycles = 0;
+
+    // Fraction of elements which passed a filter.
+    double Selectivity() const {
+      return elements_in == 0 ? 1.0 : double(elements_out) / elements_in;
+    }
+  };
+
+#ifdef RAMAN_ENABLE_STATS
+  using StatsCallback = std::function<void(const StageStats&)>;
+
+  inline StatsCallback& GlobalStatsCallback() {
+    static StatsCallback callback;
+    return callback;
+  }
+
+  // Sets a function to be called with the statistics of every stage when it
+  // is destroyed. Stages without a name of their own are reported as
+  // "Where" and "Transform" (including Keys(), Values(), etc).
+  inline void SetStatsCallback(StatsCallback callback) {
+    GlobalStatsCallback() = std::move(callback);
+  }
+#endif
+
   namespace internal {
     void DieDebugHook() {}
 
+#ifdef RAMAN_ENABLE_STATS
+    inline unsigned long long ReadCycles() {
+#  if defined(__x86_64__) || defined(__i386__) || defined(_MSC_VER)
+      return __rdtsc();
+#  else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#  endif
+    }
+
+    // Adds the cycles spent in its scope to `cycles`.
+    struct CycleTimer {
+      RAMAN_STATS_CONSTEXPR explicit CycleTimer(unsigned long long& cycles)
+        : cycles_(cycles),
+          start_(RAMAN_STATS_IS_CONSTANT_EVALUATED() ? 0 : ReadCycles()) {}
+
+      RAMAN_STATS_CONSTEXPR ~CycleTimer() {
+        if (!RAMAN_STATS_IS_CONSTANT_EVALUATED()) {
+          cycles_ += ReadCycles() - start_;
+        }
+      }
+
+     private:
+      unsigned long long& cycles_;
+      unsigned long long start_;
+    };
+
+    // Statistics of a stage, reported when the stage is destroyed, either to
+    // `output` or to the global callback. Moved-from counters don't report.
+    struct StageCounter {
+      RAMAN_STATS_CONSTEXPR explicit StageCounter(
+          const char* name, StageStats* output = nullptr)
+        : output_(output) {
+        stats.name = name;
+      }
+
+      RAMAN_STATS_CONSTEXPR StageCounter(StageCounter&& o)
+        : stats(o.stats),
+          output_(o.output_),
+          is_active_(o.is_active_) {
+        o.is_active_ = false;
+      }
+
+      RAMAN_STATS_CONSTEXPR StageCounter& operator=(StageCounter&& o) {
+        stats = o.stats;
+        output_ = o.output_;
+        is_active_ = o.is_active_;
+        o.is_active_ = false;
+        return *this;
+      }
+
+      // For stages removed by fusion, which must not be reported.
+      RAMAN_STATS_CONSTEXPR void Discard() { is_active_ = false; }
+
+      RAMAN_STATS_CONSTEXPR ~StageCounter() {
+        if (!is_active_ || RAMAN_STATS_IS_CONSTANT_EVALUATED()) {
+          return;
+        }
+        if (output_ != nullptr) {
+          *output_ = stats;
+        } else if (GlobalStatsCallback()) {
+          GlobalStatsCallback()(stats);
+        }
+      }
+
+      StageStats stats;
+
+     private:
+      StageStats* output_;
+      bool is_active_ = true;
+    };
+#endif
+
     template <typename Container>
     using IteratorOf = typename Container::iterator;
 
@@ -73,63 +300,230 @@ namespace raman {
     using ValueType =
         typename std::remove_reference<ReferenceType<Range>>::type;
 
+    // Copies of T. Tuples and pairs of references, as yielded by Zip() and
+    // Enumerate(), are copied into tuples and pairs of values: assigning
+    // copies of them would otherwise write through to the original elements.
+    template <typename T>
+    using StorableMember = typename std::conditional<
+        std::is_reference<T>::value, typename std::decay<T>::type, T>::type;
+
+    template <typename T>
+    struct Storable {
+      using Type = T;
+    };
+    template <typename... Ts>
+    struct Storable<std::tuple<Ts...>> {
+      using Type = std::tuple<StorableMember<Ts>...>;
+    };
+    template <typename First, typename Second>
+    struct Storable<std::pair<First, Second>> {
+      using Type = std::pair<StorableMember<First>, StorableMember<Second>>;
+    };
+
+    // Like ValueType, but suitable for storing copies of the elements.
+    template <typename Range>
+    using StorableValueType = typename Storable<
+        typename std::decay<ReferenceType<Range>>::type>::Type;
+
+    // What Transformer returns for elements of Range.
+    template <typename Range, typename Transformer>
+    using TransformedType = decltype(std::declval<Transformer&>()(
+        *std::declval<typename Range::iterator&>()));
+
+    template <typename Iterator>
+    using IteratorCategory =
+        typename std::iterator_traits<Iterator>::iterator_category;
+
+    template <typename Range>
+    using RangeCategory = IteratorCategory<typename Range::iterator>;
+
+    // Whether Range's iterators are at least of the given Category.
+    template <typename Category, typename Range>
+    constexpr bool HasCategory() {
+      return std::is_base_of<Category, RangeCategory<Range>>::value;
+    }
+
+    // Adapters only implement ++ and --, so they can't claim more than
+    // bidirectional traversal even if the underlying range can do better.
+    template <typename Iterator>
+    using AdaptedCategory = typename std::conditional<
+        std::is_base_of<std::bidirectional_iterator_tag,
+                        IteratorCategory<Iterator>>::value,
+        std::bidirectional_iterator_tag,
+        IteratorCategory<Iterator>>::type;
+
+    template <typename T, typename = void>
+    struct IsRange : std::false_type {};
+    template <typename T>
+    struct IsRange<T, decltype(void(std::declval<T&>().begin()))>
+        : std::true_type {};
+
+    constexpr bool And() { return true; }
+    template <typename... Rest>
+    constexpr bool And(bool first, Rest... rest) {
+      return first && And(rest...);
+    }
+
+    // Whether the elements of Range may be referred to by address after the
+    // iterator pointing at them has advanced. This is not the case for
+    // single-pass (input) ranges, nor for ranges producing temporaries.
+    template <typename Range>
+    constexpr bool IsAddressable() {
+      return HasCategory<std::forward_iterator_tag, Range>() &&
+             std::is_lvalue_reference<ReferenceType<Range>>::value;
+    }
+
     template <typename T>
     constexpr bool IsAssignable() {
       return std::is_copy_assignable<T>::value;
     }
 
-    // Horrible, horrible hack to allow copy/move assignment of functors, which
-    // prior to C++20 can't be assigned.
-    template <typename Functor, typename = void>
+    // Empty functors, like captureless lambdas, are held as base classes so
+    // that they take no space.
+    template <typename Functor>
+    constexpr bool IsEmptyBase() {
+      return std::is_empty<Functor>::value && !std::is_final<Functor>::value;
+    }
+
+    // Holds a functor. Ranges (and functors combining others) derive from it,
+    // so that empty functors don't make pipelines and their iterators any
+    // larger. `kSlot` tells apart bases holding functors of the same type.
+    // Also a horrible, horrible hack to allow copy/move assignment of
+    // functors, which prior to C++20 can't be assigned.
+    template <typename Functor, int kSlot = 0, typename = void>
     struct AssignableFunctor;
 
-    template <typename Functor>
+    template <typename Functor, int kSlot>
+    struct AssignableFunctor<
+        Functor, kSlot,
+        typename std::enable_if<IsEmptyBase<Functor>()>::type>
+        : private Functor {
+      constexpr AssignableFunctor(Functor functor)
+        : Functor(std::move(functor)) {}
+
+      AssignableFunctor(const AssignableFunctor&) = default;
+      AssignableFunctor(AssignableFunctor&&) = default;
+      // There is no state to assign.
+      constexpr AssignableFunctor& operator=(AssignableFunctor&& o) {
+        return *this;
+      }
+
+      constexpr Functor& Get() { return *this; }
+      constexpr const Functor& Get() const { return *this; }
+    };
+
+    template <typename Functor, int kSlot>
     struct AssignableFunctor<
-        Functor,
-        typename std::enable_if<IsAssignable<Functor>()>::type> {
-      AssignableFunctor(Functor functor_arg)
-        : functor(std::move(functor_arg)) {}
+        Functor, kSlot,
+        typename std::enable_if<!IsEmptyBase<Functor>() &&
+                                IsAssignable<Functor>()>::type> {
+      constexpr AssignableFunctor(Functor functor)
+        : functor_(std::move(functor)) {}
 
+      AssignableFunctor(const AssignableFunctor&) = default;
       AssignableFunctor(AssignableFunctor&&) = default;
       AssignableFunctor& operator=(AssignableFunctor&& o) = default;
 
-      Functor functor;
+      constexpr Functor& Get() { return functor_; }
+      constexpr const Functor& Get() const { return functor_; }
+
+     private:
+      Functor functor_;
     };
 
-    template <typename Functor>
+    template <typename Functor, int kSlot>
     struct AssignableFunctor<
-        Functor,
-        typename std::enable_if<!IsAssignable<Functor>()>::type> {
-      AssignableFunctor(Functor functor_arg)
-        : functor(std::move(functor_arg)) {}
+        Functor, kSlot,
+        typename std::enable_if<!IsEmptyBase<Functor>() &&
+                                !IsAssignable<Functor>()>::type> {
+      constexpr AssignableFunctor(Functor functor)
+        : functor_(std::move(functor)) {}
 
+      AssignableFunctor(const AssignableFunctor&) = default;
       AssignableFunctor(AssignableFunctor&&) = default;
       AssignableFunctor& operator=(AssignableFunctor&& o) {
-        functor.~Functor();
-        new (&functor) Functor(std::move(o.functor));
+        functor_.~Functor();
+        new (&functor_) Functor(std::move(o.functor_));
+        return *this;
+      }
+
+      constexpr Functor& Get() { return functor_; }
+      constexpr const Functor& Get() const { return functor_; }
+
+     private:
+      Functor functor_;
+    };
+
+    // Minimal optional value, as std::optional requires C++17. Used by stages
+    // which must hold on to an element without allocating.
+    template <typename T>
+    struct Optional {
+      Optional() = default;
+
+      Optional(Optional&& o) {
+        if (o.HasValue()) {
+          Emplace(std::move(o.Value()));
+        }
+      }
+
+      Optional& operator=(Optional&& o) {
+        Reset();
+        if (o.HasValue()) {
+          Emplace(std::move(o.Value()));
+        }
         return *this;
       }
 
-      Functor functor;
+      ~Optional() { Reset(); }
+
+      template <typename... Args>
+      void Emplace(Args&&... args) {
+        Reset();
+        new (storage_) T(std::forward<Args>(args)...);
+        has_value_ = true;
+      }
+
+      void Reset() {
+        if (has_value_) {
+          Value().~T();
+          has_value_ = false;
+        }
+      }
+
+      bool HasValue() const { return has_value_; }
+
+      T& Value() {
+        RAMAN_ASSERT(has_value_);
+        return *reinterpret_cast<T*>(storage_);
+      }
+
+      const T& Value() const {
+        RAMAN_ASSERT(has_value_);
+        return *reinterpret_cast<const T*>(storage_);
+      }
+
+     private:
+      alignas(T) unsigned char storage_[sizeof(T)];
+      bool has_value_ = false;
     };
 
     template <typename Iterator>
     struct SimpleRange {
       using iterator = Iterator;
 
-      explicit SimpleRange(Iterator begin, Iterator end)
+      constexpr explicit SimpleRange(Iterator begin, Iterator end)
         : begin_(std::move(begin)),
           end_(std::move(end)) {}
 
       SimpleRange(SimpleRange&&) = default;
       SimpleRange& operator=(SimpleRange&&) = default;
 
-      bool operator==(const SimpleRange& o) const {
+      constexpr bool operator==(const SimpleRange& o) const {
         return (begin_ == o.begin_ && end_ == o.end_);
       }
 
-      iterator begin() { return begin_; }
-      iterator end() { return end_; }
+      constexpr iterator begin() { return begin_; }
+      constexpr iterator end() { return end_; }
 
      private:
       iterator begin_;
@@ -138,7 +532,7 @@ namespace raman {
 
     template <typename Container>
     struct ContainerOwner {
-      explicit ContainerOwner(Container&& container)
+      constexpr explicit ContainerOwner(Container&& container)
         : container_(std::move(container)) {}
 
       ContainerOwner(ContainerOwner&&) = default;
@@ -149,240 +543,184 @@ namespace raman {
     };
 
     // Like SimpleRange, but also owns the container. Built for rvalues.
+    // Iterators are not cached, as some containers (like list) invalidate
+    // their end() when moved.
     template <typename Container>
-    struct SimpleRangeOwner : ContainerOwner<Container>,
-                              SimpleRange<typename Container::iterator> {
-      explicit SimpleRangeOwner(Container&& container)
-        : ContainerOwner<Container>(std::move(container)),
-          SimpleRange<IteratorOf<Container>>(
-              this->container_.begin(),
-              this->container_.end()) {}
+    struct SimpleRangeOwner : ContainerOwner<Container> {
+      using iterator = IteratorOf<Container>;
+
+      constexpr explicit SimpleRangeOwner(Container&& container)
+        : ContainerOwner<Container>(std::move(container)) {}
 
       SimpleRangeOwner(SimpleRangeOwner&& o) = default;
       SimpleRangeOwner& operator=(SimpleRangeOwner&& o) = default;
+
+      constexpr iterator begin() { return this->container_.begin(); }
+      constexpr iterator end() { return this->container_.end(); }
     };
 
-    // Filtered range.
-    template <typename Range, typename Filter>
-    struct FilteredRange {
-      explicit FilteredRange(Range range, Filter filter)
-        : range_(std::move(range)),
-          filter_(std::move(filter)) {}
+    // Integers (or anything incrementable) in [begin, end), computed on the
+    // fly.
+    template <typename T>
+    struct IotaRange {
+      constexpr explicit IotaRange(T begin, T end)
+        : begin_(std::move(begin)),
+          end_(std::move(end)) {}
 
-      FilteredRange(FilteredRange&&) = default;
-      FilteredRange& operator=(FilteredRange&&) = default;
+      IotaRange(IotaRange&&) = default;
+      IotaRange& operator=(IotaRange&&) = default;
 
       struct iterator {
         // iterator typedefs.
-        using iterator_category = typename Range::iterator::iterator_category;
-        using value_type = typename Range::iterator::value_type;
-        using difference_type = typename Range::iterator::difference_type;
-        using pointer = typename Range::iterator::pointer;
-        using reference = typename Range::iterator::reference;
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = T;
 
-        explicit iterator(FilteredRange* const range,
-                          typename Range::iterator iterator)
-          : range_(range),
-            iterator_(iterator) {
-          this->AdvanceToNextNonFilteredIfNeeded();
-        }
+        constexpr iterator()
+          : value_() {}
+        constexpr explicit iterator(T value)
+          : value_(std::move(value)) {}
 
         iterator(const iterator&) = default;
         iterator& operator=(const iterator&) = default;
         iterator(iterator&&) = default;
         iterator& operator=(iterator&&) = default;
 
-        decltype(auto) operator*() const {
-          RAMAN_ASSERT(iterator_ != range_->range_.end());
-          return *iterator_;
-        }
+        constexpr T operator*() const { return value_; }
+        constexpr T operator[](difference_type n) const { return value_ + n; }
 
-        decltype(auto) operator->() const {
+        constexpr iterator& operator++() {
+          ++value_;
           return *this;
         }
 
-        iterator& operator++() {
-          RAMAN_ASSERT(iterator_ != range_->range_.end());
-          ++iterator_;
-          AdvanceToNextNonFilteredIfNeeded();
-          return *this;
+        constexpr iterator operator++(int) {
+          iterator old = *this;
+          ++value_;
+          return old;
         }
 
-        iterator& operator--() {
-          RAMAN_ASSERT(iterator_ != range_->range_.begin());
-          --iterator_;
-          RetreatToPreviousNonFilteredIfNeeded();
+        constexpr iterator& operator--() {
+          --value_;
           return *this;
         }
 
-        bool operator==(const iterator& o) const {
-          return (range_ == o.range_ && iterator_ == o.iterator_);
+        constexpr iterator operator--(int) {
+          iterator old = *this;
+          --value_;
+          return old;
         }
 
-        bool operator!=(const iterator& o) const {
-          return !(*this == o);
+        constexpr iterator& operator+=(difference_type n) {
+          value_ += n;
+          return *this;
         }
 
-       private:
-        // Will not advance if current element is not filtered.
-        void AdvanceToNextNonFilteredIfNeeded() {
-          while (iterator_ != range_->range_.end() &&
-                 !range_->filter_.functor(*iterator_)) {
-            ++iterator_;
-          }
+        constexpr iterator& operator-=(difference_type n) {
+          value_ -= n;
+          return *this;
         }
 
-        void RetreatToPreviousNonFilteredIfNeeded() {
-          while (iterator_ != range_->range_.begin() &&
-                 !range_->filter_.functor(*iterator_)) {
-            --iterator_;
-          }
+        constexpr iterator operator+(difference_type n) const {
+          return iterator(value_ + n);
         }
 
-        FilteredRange* const range_;
-        typename Range::iterator iterator_;
-      };
-
-      bool operator==(const FilteredRange& o) const {
-        return (range_ == o.range_ && filter_.functor == o.filter_.functor);
-      }
-
-      iterator begin() {
-        return iterator(this, range_.begin());
-      }
-
-      iterator end() {
-        return iterator(this, range_.end());
-      }
-
-     private:
-      Range range_;
-      AssignableFunctor<Filter> filter_;
-    };
-
-    template <typename Iterator>
-    struct SimpleRangeIterator {
-      // iterator typedefs.
-      using iterator_category = typename Iterator::iterator_category;
-      using value_type = typename Iterator::value_type;
-      using difference_type = typename Iterator::difference_type;
-      using pointer = typename Iterator::pointer;
-      using reference = typename Iterator::reference;
-
-      explicit SimpleRangeIterator(Iterator iterator)
-        : iterator_(iterator) {}
-
-      SimpleRangeIterator(const SimpleRangeIterator&) = default;
-      SimpleRangeIterator& operator=(const SimpleRangeIterator&) = default;
-      SimpleRangeIterator(SimpleRangeIterator&&) = default;
-      SimpleRangeIterator& operator=(SimpleRangeIterator&&) = default;
-
-      SimpleRangeIterator& operator++() {
-        ++iterator_;
-        return *this;
-      }
-
-      SimpleRangeIterator& operator--() {
-        --iterator_;
-        return *this;
-      }
-
-     protected:
-      Iterator iterator_;
-    };
+        friend constexpr iterator operator+(difference_type n,
+                                            const iterator& it) {
+          return it + n;
+        }
 
-    template <typename Range, typename Transformer>
-    struct ByValueTransformerRange {
-      explicit ByValueTransformerRange(Range range, Transformer transformer)
-        : range_(std::move(range)),
-          transformer_(std::move(transformer)) {}
+        constexpr iterator operator-(difference_type n) const {
+          return iterator(value_ - n);
+        }
 
-      ByValueTransformerRange(ByValueTransformerRange&&) = default;
-      ByValueTransformerRange& operator=(ByValueTransformerRange&&) = default;
+        constexpr difference_type operator-(const iterator& o) const {
+          return static_cast<difference_type>(value_ - o.value_);
+        }
 
-      struct iterator : SimpleRangeIterator<typename Range::iterator> {
-        iterator(ByValueTransformerRange* const range,
-                 typename Range::iterator iterator)
-          : SimpleRangeIterator<typename Range::iterator>(std::move(iterator)),
-            range_(range) {}
+        constexpr bool operator==(const iterator& o) const {
+          return value_ == o.value_;
+        }
 
-        iterator(const iterator&) = default;
-        iterator& operator=(const iterator&) = default;
-        iterator(iterator&&) = default;
-        iterator& operator=(iterator&&) = default;
+        constexpr bool operator!=(const iterator& o) const {
+          return value_ != o.value_;
+        }
 
-        auto operator*() const {
-          RAMAN_ASSERT(this->iterator_ != range_->range_.end());
-          return range_->transformer_.functor(*this->iterator_);
+        constexpr bool operator<(const iterator& o) const {
+          return value_ < o.value_;
         }
 
-        auto operator->() const {
-          return *this;
+        constexpr bool operator>(const iterator& o) const {
+          return o < *this;
         }
 
-        bool operator==(const iterator& o) const {
-          return (range_ == o.range_ && this->iterator_ == o.iterator_);
+        constexpr bool operator<=(const iterator& o) const {
+          return !(o < *this);
         }
 
-        bool operator!=(const iterator& o) const {
-          return !(*this == o);
+        constexpr bool operator>=(const iterator& o) const {
+          return !(*this < o);
         }
 
        private:
-        ByValueTransformerRange* const range_;
+        T value_;
       };
 
-      bool operator==(const ByValueTransformerRange& o) const {
-        return (this->range_ == o.range_ &&
-                transformer_.functor == o.transformer_.functor);
-      }
-
-      iterator begin() {
-        return iterator(this, range_.begin());
-      }
-
-      iterator end() {
-        return iterator(this, range_.end());
-      }
+      constexpr iterator begin() { return iterator(begin_); }
+      constexpr iterator end() { return iterator(end_); }
 
      private:
-      Range range_;
-      AssignableFunctor<Transformer> transformer_;
-      friend struct iterator;
+      T begin_;
+      T end_;
     };
 
-    // Transformer range.
-    template <typename Range, typename Transformer>
-    struct ByRefTransformerRange {
-      explicit ByRefTransformerRange(Range range, Transformer transformer)
-        : range_(std::move(range)),
-          transformer_(std::move(transformer)) {}
+    // Values returned by successive calls to a generator functor. This is a
+    // single-pass range: the current value is held by the range itself.
+    template <typename Generator>
+    struct GeneratedRange : private AssignableFunctor<Generator> {
+      using Value = typename std::decay<
+          decltype(std::declval<Generator&>()())>::type;
 
-      ByRefTransformerRange(ByRefTransformerRange&&) = default;
-      ByRefTransformerRange& operator=(ByRefTransformerRange&&) = default;
+      explicit GeneratedRange(Generator generator, std::size_t count)
+        : AssignableFunctor<Generator>(std::move(generator)),
+          count_(count) {}
 
-      struct iterator : SimpleRangeIterator<typename Range::iterator> {
-        iterator(ByRefTransformerRange* const range,
-                 typename Range::iterator iterator)
-          : SimpleRangeIterator<typename Range::iterator>(std::move(iterator)),
-            range_(range) {}
+      GeneratedRange(GeneratedRange&&) = default;
+      GeneratedRange& operator=(GeneratedRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Value*;
+        using reference = const Value&;
+
+        explicit iterator(GeneratedRange* range, std::size_t index)
+          : range_(range),
+            index_(index) {}
 
         iterator(const iterator&) = default;
         iterator& operator=(const iterator&) = default;
         iterator(iterator&&) = default;
         iterator& operator=(iterator&&) = default;
 
-        decltype(auto) operator*() const {
-          RAMAN_ASSERT(this->iterator_ != range_->range_.end());
-          return range_->transformer_.functor(*this->iterator_);
+        const Value& operator*() const {
+          RAMAN_ASSERT(index_ != range_->count_);
+          return range_->current_.Value();
         }
 
-        decltype(auto) operator->() const {
+        iterator& operator++() {
+          RAMAN_ASSERT(index_ != range_->count_);
+          ++index_;
+          range_->GenerateIfNeeded(index_);
           return *this;
         }
 
         bool operator==(const iterator& o) const {
-          return (this->range_ == o.range_ && this->iterator_ == o.iterator_);
+          return (range_ == o.range_ && index_ == o.index_);
         }
 
         bool operator!=(const iterator& o) const {
@@ -390,124 +728,633 @@ namespace raman {
         }
 
        private:
-        ByRefTransformerRange* const range_;
+        GeneratedRange* range_;
+        std::size_t index_;
       };
 
-      bool operator==(const ByRefTransformerRange& o) const {
-        return (this->range_ == o.range_ &&
-                transformer_.functor == o.transformer_.functor);
-      }
-
       iterator begin() {
-        return iterator(this, range_.begin());
+        GenerateIfNeeded(0);
+        return iterator(this, 0);
       }
 
       iterator end() {
-        return iterator(this, range_.end());
+        return iterator(this, count_);
       }
 
      private:
-      Range range_;
-      AssignableFunctor<Transformer> transformer_;
-      friend struct iterator;
+      void GenerateIfNeeded(std::size_t index) {
+        if (index != count_) {
+          current_.Emplace(generator()());
+        }
+      }
+
+      Generator& generator() { return AssignableFunctor<Generator>::Get(); }
+
+      std::size_t count_;
+      Optional<Value> current_;
     };
 
+#ifdef RAMAN_HAS_CHARCONV
+    // How FromCsv() parses each type of field: numbers in place with
+    // std::from_chars, and anything else once the field's end is found.
+    struct ParseAsNumber {};
+    struct ParseAsFloat {};
+    struct ParseAsChar {};
+    struct ParseAsText {};
+
     template <typename T>
-    struct DereferenceFunctor {
-      DereferenceFunctor() = default;
+    using ParseTag = typename std::conditional<
+        std::is_same<T, char>::value, ParseAsChar,
+        typename std::conditional<
+            std::is_integral<T>::value, ParseAsNumber,
+            typename std::conditional<
+#  ifdef __cpp_lib_to_chars
+                std::is_floating_point<T>::value, ParseAsNumber,
+#  else
+                std::is_floating_point<T>::value, ParseAsFloat,
+#  endif
+                ParseAsText>::type>::type>::type;
 
-      DereferenceFunctor(const DereferenceFunctor&) = default;
-      DereferenceFunctor(DereferenceFunctor&&) = default;
-      DereferenceFunctor& operator=(const DereferenceFunctor&) = default;
-      DereferenceFunctor& operator=(DereferenceFunctor&&) = default;
+    template <typename T>
+    bool ParseWhole(const char* begin, const char* end, T& value,
+                    ParseAsNumber) {
+      auto result = std::from_chars(begin, end, value);
+      return result.ec == std::errc() && result.ptr == end;
+    }
+#  ifndef __cpp_lib_to_chars
+    inline void ParseFloat(const char* text, char** end, float& value) {
+      value = std::strtof(text, end);
+    }
+    inline void ParseFloat(const char* text, char** end, double& value) {
+      value = std::strtod(text, end);
+    }
+    inline void ParseFloat(const char* text, char** end, long double& value) {
+      value = std::strtold(text, end);
+    }
+    // std::strto*() need a terminating '\0', so fields are copied first.
+    template <typename T>
+    bool ParseWhole(const char* begin, const char* end, T& value,
+                    ParseAsFloat) {
+      char text[64];
+      std::size_t size = static_cast<std::size_t>(end - begin);
+      if (size == 0 || size >= sizeof(text)) {
+        return false;
+      }
+      std::memcpy(text, begin, size);
+      text[size] = '\0';
+      char* parsed_end;
+      ParseFloat(text, &parsed_end, value);
+      return parsed_end == text + size;
+    }
+#  endif
+    inline bool ParseWhole(const char* begin, const char* end, char& value,
+                           ParseAsChar) {
+      if (end - begin != 1) {
+        return false;
+      }
+      value = *begin;
+      return true;
+    }
+    // std::string_view refers to the text, other types (like std::string)
+    // copy it.
+    template <typename T>
+    bool ParseWhole(const char* begin, const char* end, T& value,
+                    ParseAsText) {
+      value = T(begin, static_cast<std::size_t>(end - begin));
+      return true;
+    }
 
-      decltype(auto) operator()(const T& t) const {
-        return *t;
+    // Views can't collapse escaped quotes, so they keep them.
+    template <typename T>
+    bool ParseQuotedText(const char* begin, const char* end, T& value,
+                         std::true_type /* is_view */) {
+      return ParseWhole(begin, end, value, ParseAsText());
+    }
+    // Other types (like std::string) copy the text, with each "" as ".
+    template <typename T>
+    bool ParseQuotedText(const char* begin, const char* end, T& value,
+                         std::false_type /* is_view */) {
+      value = T();
+      while (true) {
+        const char* quote = static_cast<const char*>(std::memchr(
+            begin, '"', static_cast<std::size_t>(end - begin)));
+        if (quote == nullptr) {
+          value.append(begin, static_cast<std::size_t>(end - begin));
+          return true;
+        }
+        // Keeps the first quote of each "" pair.
+        value.append(begin, static_cast<std::size_t>(quote + 1 - begin));
+        begin = quote + 2;
       }
+    }
 
-      bool operator==(const DereferenceFunctor& o) const {
-        return true;
+    // Parses the text between the quotes of a quoted field, in which quotes
+    // are escaped as "". Only text fields can hold escaped quotes.
+    template <typename T, typename Tag>
+    bool ParseQuoted(const char* begin, const char* end, T& value, Tag tag) {
+      return ParseWhole(begin, end, value, tag);
+    }
+    template <typename T>
+    bool ParseQuoted(const char* begin, const char* end, T& value,
+                     ParseAsText) {
+      return ParseQuotedText(begin, end, value,
+                             std::is_same<T, std::string_view>());
+    }
+
+    // Parses the unquoted field starting at `begin`, in a row ending at
+    // `end`. Returns the end of the field, or nullptr if it doesn't parse.
+    template <typename T>
+    const char* ParseField(const char* begin, const char* end, char, T& value,
+                           ParseAsNumber) {
+      auto result = std::from_chars(begin, end, value);
+      return result.ec == std::errc() ? result.ptr : nullptr;
+    }
+    template <typename T, typename Tag>
+    const char* ParseField(const char* begin, const char* end, char separator,
+                           T& value, Tag tag) {
+      const char* field_end = static_cast<const char*>(std::memchr(
+          begin, separator, static_cast<std::size_t>(end - begin)));
+      if (field_end == nullptr) {
+        field_end = end;
+      }
+      return ParseWhole(begin, field_end, value, tag) ? field_end : nullptr;
+    }
+
+    // Rows of Types parsed from CSV text, as std::tuple<Types...>. Fields
+    // are separated by `separator`, and may be quoted ("a, ""b""") to hold
+    // separators, quotes and line breaks. Separators, quotes and line ends
+    // are found with std::memchr(), which standard libraries vectorize.
+    // Rows without exactly one field per type, or with a field which
+    // doesn't parse as its type, are skipped, as are blank lines.
+    template <typename... Types>
+    struct CsvRange {
+      using Value = std::tuple<Types...>;
+
+      explicit CsvRange(const char* begin, const char* end, char separator,
+                        bool has_header)
+        : begin_(begin),
+          end_(end),
+          separator_(separator),
+          has_header_(has_header) {
+        RAMAN_ASSERT(separator != '"' && separator != '\n');
+      }
+
+      CsvRange(CsvRange&&) = default;
+      CsvRange& operator=(CsvRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        // Rows are parsed into the iterator, so they are returned by value
+        // like Iota() does, to keep them valid once it moves on.
+        using reference = Value;
+
+        explicit iterator(const CsvRange* range, const char* row)
+          : range_(range),
+            row_(row) {
+          Parse();
+        }
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        Value operator*() const {
+          RAMAN_ASSERT(row_ != range_->end_);
+          return current_;
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(row_ != range_->end_);
+          row_ = next_;
+          Parse();
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const { return row_ == o.row_; }
+
+        bool operator!=(const iterator& o) const { return row_ != o.row_; }
+
+       private:
+        // Moves row_ to the first well formed row from there, if any.
+        void Parse() {
+          while (row_ != range_->end_ &&
+                 !ParseRow(std::index_sequence_for<Types...>())) {
+            row_ = next_;
+          }
+        }
+
+        // Whether row_ is well formed, parsing it into current_ if so.
+        template <std::size_t... kIndices>
+        bool ParseRow(std::index_sequence<kIndices...>) {
+          FindLineEnd(row_);
+          if (row_end_ == row_) {
+            return false;
+          }
+          const char* cursor = row_;
+          bool is_valid = true;
+          int unused[] = {
+              0, (is_valid = is_valid &&
+                             ParseColumn(cursor, std::get<kIndices>(current_),
+                                         kIndices + 1 == sizeof...(Types)),
+                  0)...};
+          (void)unused;
+          return is_valid;
+        }
+
+        template <typename T>
+        bool ParseColumn(const char*& cursor, T& value, bool is_last) {
+          if (cursor != row_end_ && *cursor == '"') {
+            const char* quote = FindClosingQuote(cursor + 1);
+            if (quote == nullptr ||
+                !ParseQuoted(cursor + 1, quote, value, ParseTag<T>())) {
+              return false;
+            }
+            // Line breaks within quotes are part of the field.
+            if (quote >= row_end_) {
+              FindLineEnd(quote);
+            }
+            cursor = quote + 1;
+          } else {
+            cursor = ParseField(cursor, row_end_, range_->separator_, value,
+                                ParseTag<T>());
+            if (cursor == nullptr) {
+              return false;
+            }
+          }
+          if (is_last) {
+            return cursor == row_end_;
+          }
+          if (cursor == row_end_ || *cursor != range_->separator_) {
+            return false;
+          }
+          ++cursor;
+          return true;
+        }
+
+        // Sets row_end_ and next_ for the line `from` is on.
+        void FindLineEnd(const char* from) {
+          const char* end = range_->end_;
+          const char* line_end = static_cast<const char*>(std::memchr(
+              from, '\n', static_cast<std::size_t>(end - from)));
+          if (line_end == nullptr) {
+            line_end = next_ = end;
+          } else {
+            next_ = line_end + 1;
+          }
+          // Also reads lines ending with "\r\n".
+          row_end_ = (line_end != from && line_end[-1] == '\r')
+                         ? line_end - 1
+                         : line_end;
+        }
+
+        // The quote closing a field whose text starts at `from`, skipping
+        // escaped ("") quotes, or nullptr.
+        const char* FindClosingQuote(const char* from) const {
+          const char* end = range_->end_;
+          while (true) {
+            const char* quote = static_cast<const char*>(std::memchr(
+                from, '"', static_cast<std::size_t>(end - from)));
+            if (quote == nullptr || quote + 1 == end || quote[1] != '"') {
+              return quote;
+            }
+            from = quote + 2;
+          }
+        }
+
+        const CsvRange* range_;
+        // The current row, and the one after it.
+        const char* row_;
+        const char* next_ = nullptr;
+        // Where the fields of row_ end.
+        const char* row_end_ = nullptr;
+        Value current_;
+      };
+
+      iterator begin() const {
+        const char* first = begin_;
+        if (has_header_) {
+          const char* line_end = static_cast<const char*>(std::memchr(
+              begin_, '\n', static_cast<std::size_t>(end_ - begin_)));
+          first = line_end == nullptr ? end_ : line_end + 1;
+        }
+        return iterator(this, first);
       }
+
+      iterator end() const { return iterator(this, end_); }
+
+     private:
+      const char* begin_;
+      const char* end_;
+      char separator_;
+      bool has_header_;
     };
+#endif
 
-    template <typename Range>
-    struct DereferenceRange
-        : ByRefTransformerRange<Range,
-                                DereferenceFunctor<ReferenceType<Range>>> {
-      explicit DereferenceRange(Range range)
-        : ByRefTransformerRange<Range,
-                                DereferenceFunctor<ReferenceType<Range>>>(
-              std::move(range), DereferenceFunctor<ReferenceType<Range>>()) {}
+    // Accepts elements accepted by both filters, in order, like
+    // Where(first).Where(second) does.
+    template <typename First, typename Second>
+    struct BothFilters : private AssignableFunctor<First, 0>,
+                         private AssignableFunctor<Second, 1> {
+      constexpr BothFilters(First first, Second second)
+        : AssignableFunctor<First, 0>(std::move(first)),
+          AssignableFunctor<Second, 1>(std::move(second)) {}
 
-      DereferenceRange(DereferenceRange&&) = default;
-      DereferenceRange& operator=(DereferenceRange&&) = default;
+      template <typename Value>
+      constexpr bool operator()(Value&& value) {
+        return AssignableFunctor<First, 0>::Get()(value) &&
+               AssignableFunctor<Second, 1>::Get()(value);
+      }
     };
 
-    template <typename Range>
-    struct ReverseRange {
-      explicit ReverseRange(Range range)
-        : range_(std::move(range)) {}
+    // Applies `first` and then `second`, like
+    // Transform(first).Transform(second) does.
+    template <typename First, typename Second>
+    struct ComposedTransformer : private AssignableFunctor<First, 0>,
+                                 private AssignableFunctor<Second, 1> {
+      constexpr ComposedTransformer(First first, Second second)
+        : AssignableFunctor<First, 0>(std::move(first)),
+          AssignableFunctor<Second, 1>(std::move(second)) {}
 
-      ReverseRange(ReverseRange&&) = default;
-      ReverseRange& operator=(ReverseRange&&) = default;
+      template <typename Value>
+      using FirstResult =
+          decltype(std::declval<First&>()(std::declval<Value>()));
+      template <typename Value>
+      using SecondResult =
+          decltype(std::declval<Second&>()(std::declval<FirstResult<Value>>()));
+      // References `second` returns may point into a temporary `first`
+      // returned, which is gone once this returns, so they are copied then.
+      template <typename Value>
+      using Result = typename std::conditional<
+          std::is_lvalue_reference<FirstResult<Value>>::value,
+          SecondResult<Value>,
+          typename std::decay<SecondResult<Value>>::type>::type;
+
+      template <typename Value>
+      constexpr Result<Value> operator()(Value&& value) {
+        return AssignableFunctor<Second, 1>::Get()(
+            AssignableFunctor<First, 0>::Get()(std::forward<Value>(value)));
+      }
+    };
+
+    // Filtered range.
+    template <typename Range, typename Filter>
+    struct FilteredRange : private AssignableFunctor<Filter> {
+      constexpr explicit FilteredRange(Range range, Filter filter)
+        : AssignableFunctor<Filter>(std::move(filter)),
+          range_(std::move(range)) {}
+
+      FilteredRange(FilteredRange&&) = default;
+      FilteredRange& operator=(FilteredRange&&) = default;
 
       struct iterator {
         // iterator typedefs.
-        using iterator_category = typename Range::iterator::iterator_category;
-        using value_type = typename Range::iterator::value_type;
-        using difference_type = typename Range::iterator::difference_type;
-        using pointer = typename Range::iterator::pointer;
-        using reference = typename Range::iterator::reference;
+        using iterator_category = AdaptedCategory<typename Range::iterator>;
+        using value_type = typename std::iterator_traits<
+            typename Range::iterator>::value_type;
+        using difference_type = typename std::iterator_traits<
+            typename Range::iterator>::difference_type;
+        using pointer = typename std::iterator_traits<
+            typename Range::iterator>::pointer;
+        using reference = typename std::iterator_traits<
+            typename Range::iterator>::reference;
 
-        explicit iterator(ReverseRange* const range,
-                          typename Range::iterator iterator,
-                          bool is_at_rend = false)
+        constexpr explicit iterator(FilteredRange* const range,
+                          typename Range::iterator iterator)
           : range_(range),
-            iterator_(iterator),
-            is_at_rend_(is_at_rend) {}
+            iterator_(iterator) {
+          this->AdvanceToNextNonFilteredIfNeeded();
+        }
 
         iterator(const iterator&) = default;
         iterator& operator=(const iterator&) = default;
         iterator(iterator&&) = default;
         iterator& operator=(iterator&&) = default;
 
-        decltype(auto) operator*() const {
+        constexpr decltype(auto) operator*() const {
           RAMAN_ASSERT(iterator_ != range_->range_.end());
-          RAMAN_ASSERT(!is_at_rend_);
           return *iterator_;
         }
 
-        decltype(auto) operator->() const {
+        constexpr decltype(auto) operator->() const {
           return *this;
         }
 
-        iterator& operator++() {
+        constexpr iterator& operator++() {
           RAMAN_ASSERT(iterator_ != range_->range_.end());
-          RAMAN_ASSERT(!is_at_rend_);
-          if (iterator_ == range_->range_.begin()) {
-            is_at_rend_ = true;
-          } else {
+          ++iterator_;
+          AdvanceToNextNonFilteredIfNeeded();
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          RAMAN_ASSERT(iterator_ != range_->range_.begin());
+          --iterator_;
+          RetreatToPreviousNonFilteredIfNeeded();
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && iterator_ == o.iterator_);
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        // Will not advance if current element is not filtered.
+        constexpr void AdvanceToNextNonFilteredIfNeeded() {
+          while (iterator_ != range_->range_.end() &&
+                 !range_->Accepts(*iterator_)) {
+            ++iterator_;
+          }
+        }
+
+        constexpr void RetreatToPreviousNonFilteredIfNeeded() {
+          while (iterator_ != range_->range_.begin() &&
+                 !range_->Accepts(*iterator_)) {
             --iterator_;
           }
-          return *this;
         }
 
-        iterator& operator--() {
+        FilteredRange* range_;
+        typename Range::iterator iterator_;
+      };
+
+      constexpr bool operator==(const FilteredRange& o) const {
+        return (range_ == o.range_ && filter() == o.filter());
+      }
+
+      constexpr iterator begin() {
+        return iterator(this, range_.begin());
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.end());
+      }
+
+      // Fuses a following Where() into this stage.
+      template <typename OtherFilter>
+      constexpr auto Where(OtherFilter other) && {
+        using Filters = BothFilters<Filter, OtherFilter>;
+        FilteredRange<Range, Filters> fused(
+            std::move(range_),
+            Filters(std::move(filter()), std::move(other)));
+        RAMAN_STATS(fused.stats_ = std::move(stats_);)
+        return fused;
+      }
+
+     private:
+      template <typename Value>
+      constexpr bool Accepts(Value&& value) {
+        RAMAN_STATS(CycleTimer timer(stats_.stats.cycles);)
+        bool accepted = filter()(std::forward<Value>(value));
+        RAMAN_STATS(
+          ++stats_.stats.calls;
+          ++stats_.stats.elements_in;
+          stats_.stats.elements_out += accepted;
+        )
+        return accepted;
+      }
+
+      constexpr Filter& filter() { return AssignableFunctor<Filter>::Get(); }
+      constexpr const Filter& filter() const {
+        return AssignableFunctor<Filter>::Get();
+      }
+
+      Range range_;
+      RAMAN_STATS(StageCounter stats_{"Where"};)
+      template <typename, typename> friend struct FilteredRange;
+    };
+
+    // The number of trailing zero bits of a non-zero `bits`.
+    inline int CountTrailingZeros(std::uint64_t bits) {
+      RAMAN_ASSERT(bits != 0);
+#if defined(__GNUC__) || defined(__clang__)
+      return __builtin_ctzll(bits);
+#else
+      int count = 0;
+      for (; (bits & 1) == 0; bits >>= 1) {
+        ++count;
+      }
+      return count;
+#endif
+    }
+
+    // The number of bits set in `bits`.
+    inline int PopCount(std::uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+      return __builtin_popcountll(bits);
+#else
+      int count = 0;
+      for (; bits != 0; bits &= bits - 1) {
+        ++count;
+      }
+      return count;
+#endif
+    }
+
+    // How many elements WhereBatch() filters at a time: one per mask bit.
+    constexpr std::size_t kBatchSize = 64;
+
+    // Calls Filter for the elements in [begin, end), at most kBatchSize of
+    // them, and returns the mask it selects them with, without bits past
+    // `count`.
+    template <typename Filter, typename Iterator>
+    std::uint64_t SelectBatch(Filter& filter, Iterator begin, Iterator end,
+                              std::size_t count) {
+      std::uint64_t mask = filter(std::move(begin), std::move(end));
+      return count == kBatchSize ? mask
+                                 : mask & ((std::uint64_t(1) << count) - 1);
+    }
+
+    // Moves `iterator` up to `count` elements forward, without passing
+    // `end`, and returns the number of elements it moved.
+    template <typename Iterator>
+    std::size_t AdvanceUpTo(Iterator& iterator, const Iterator& end,
+                            std::size_t count,
+                            std::random_access_iterator_tag) {
+      count = std::min(count, static_cast<std::size_t>(end - iterator));
+      iterator += static_cast<std::ptrdiff_t>(count);
+      return count;
+    }
+    template <typename Iterator>
+    std::size_t AdvanceUpTo(Iterator& iterator, const Iterator& end,
+                            std::size_t count, std::forward_iterator_tag) {
+      std::size_t advanced = 0;
+      for (; advanced < count && iterator != end; ++advanced) {
+        ++iterator;
+      }
+      return advanced;
+    }
+
+    // Elements of Range which Filter selects, as WhereBatch() does: Filter
+    // is called with iterators to blocks of up to kBatchSize consecutive
+    // elements, and returns a mask of those it accepts, bit i standing for
+    // element i of the block. Iteration then skips over unselected elements
+    // a run at a time. Forward ranges are filtered in place; see the
+    // specialization below for single-pass ones.
+    template <typename Range, typename Filter,
+              bool kMultiPass = HasCategory<std::forward_iterator_tag, Range>()>
+    struct BatchFilteredRange : private AssignableFunctor<Filter> {
+      explicit BatchFilteredRange(Range range, Filter filter)
+        : AssignableFunctor<Filter>(std::move(filter)),
+          range_(std::move(range)) {}
+
+      BatchFilteredRange(BatchFilteredRange&&) = default;
+      BatchFilteredRange& operator=(BatchFilteredRange&&) = default;
+
+      struct iterator {
+        using Iterator = typename Range::iterator;
+
+        // iterator typedefs.
+        using iterator_category = std::forward_iterator_tag;
+        using value_type =
+            typename std::iterator_traits<Iterator>::value_type;
+        using difference_type =
+            typename std::iterator_traits<Iterator>::difference_type;
+        using pointer = typename std::iterator_traits<Iterator>::pointer;
+        using reference = typename std::iterator_traits<Iterator>::reference;
+
+        explicit iterator(BatchFilteredRange* range, Iterator iterator)
+          : range_(range),
+            iterator_(iterator),
+            block_end_(std::move(iterator)) {
+          FilterBlocks();
+        }
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        decltype(auto) operator*() const {
           RAMAN_ASSERT(iterator_ != range_->range_.end());
-          if (is_at_rend_) {
-            RAMAN_ASSERT(iterator_ == range_->range_.begin());
-            is_at_rend_ = false;
+          return *iterator_;
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          // Bit 0 of mask_ stands for the element at iterator_.
+          mask_ >>= 1;
+          if (mask_ == 0) {
+            iterator_ = block_end_;
+            FilterBlocks();
           } else {
-            ++iterator_;
-            RAMAN_ASSERT(iterator_ != range_->range_.begin());
+            int skipped = CountTrailingZeros(mask_);
+            std::advance(iterator_, skipped + 1);
+            mask_ >>= skipped;
           }
           return *this;
         }
 
         bool operator==(const iterator& o) const {
-          return (range_ == o.range_ &&
-                  iterator_ == o.iterator_ &&
-                  is_at_rend_ == o.is_at_rend_);
+          return (range_ == o.range_ && iterator_ == o.iterator_);
         }
 
         bool operator!=(const iterator& o) const {
@@ -515,32 +1362,4206 @@ namespace raman {
         }
 
        private:
-        ReverseRange* const range_;
-        typename Range::iterator iterator_;
-        bool is_at_rend_;
+        // Filters blocks from iterator_ on, until one has selected elements,
+        // and moves to the first of those.
+        void FilterBlocks() {
+          Iterator end = range_->range_.end();
+          while (iterator_ != end) {
+            std::size_t count = AdvanceUpTo(block_end_, end, kBatchSize,
+                                            IteratorCategory<Iterator>());
+            mask_ = range_->Select(iterator_, block_end_, count);
+            if (mask_ != 0) {
+              int skipped = CountTrailingZeros(mask_);
+              std::advance(iterator_, skipped);
+              mask_ >>= skipped;
+              return;
+            }
+            iterator_ = block_end_;
+          }
+        }
+
+        BatchFilteredRange* range_;
+        Iterator iterator_;
+        Iterator block_end_;
+        std::uint64_t mask_ = 0;
       };
 
-      bool operator==(const ReverseRange& o) const {
-        return (range_ == o.range_);
-      }
+      iterator begin() { return iterator(this, range_.begin()); }
 
-      iterator begin() {
-        auto inner_it = range_.end();
-        if (inner_it == range_.begin()) {
-          return iterator(this, inner_it, true);
-        } else {
-          --inner_it;
-          return iterator(this, inner_it);
-        }
-      }
+      iterator end() { return iterator(this, range_.end()); }
 
-      iterator end() {
-        return iterator(this, range_.begin(), true);
+     private:
+      template <typename Iterator>
+      std::uint64_t Select(Iterator begin, Iterator end, std::size_t count) {
+        RAMAN_STATS(CycleTimer timer(stats_.stats.cycles);)
+        std::uint64_t mask = SelectBatch(filter(), std::move(begin),
+                                         std::move(end), count);
+        RAMAN_STATS(
+          ++stats_.stats.calls;
+          stats_.stats.elements_in += count;
+          stats_.stats.elements_out += PopCount(mask);
+        )
+        return mask;
       }
 
-     private:
-      Range range_;
-    };
+      Filter& filter() { return AssignableFunctor<Filter>::Get(); }
+
+      Range range_;
+      RAMAN_STATS(StageCounter stats_{"WhereBatch"};)
+    };
+
+    // Single-pass ranges can't be walked again once filtered, so their
+    // elements are copied into a block, which Filter gets iterators to.
+    template <typename Range, typename Filter>
+    struct BatchFilteredRange<Range, Filter, false>
+        : private AssignableFunctor<Filter> {
+      using Value = StorableValueType<Range>;
+
+      explicit BatchFilteredRange(Range range, Filter filter)
+        : AssignableFunctor<Filter>(std::move(filter)),
+          range_(std::move(range)) {}
+
+      BatchFilteredRange(BatchFilteredRange&&) = default;
+      BatchFilteredRange& operator=(BatchFilteredRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        explicit iterator(BatchFilteredRange* range, bool is_end)
+          : range_(range),
+            is_end_(is_end) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        Value& operator*() const {
+          RAMAN_ASSERT(!IsEnd());
+          return range_->block_[range_->index_];
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(!IsEnd());
+          range_->Advance();
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && IsEnd() == o.IsEnd());
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        bool IsEnd() const { return is_end_ || range_->is_done_; }
+
+        BatchFilteredRange* range_;
+        bool is_end_;
+      };
+
+      iterator begin() {
+        input_.Emplace(range_.begin());
+        block_.reserve(kBatchSize);
+        FilterBlocks();
+        return iterator(this, false);
+      }
+
+      iterator end() { return iterator(this, true); }
+
+     private:
+      void Advance() {
+        // Bit 0 of mask_ stands for block_[index_].
+        mask_ >>= 1;
+        if (mask_ == 0) {
+          FilterBlocks();
+        } else {
+          int skipped = CountTrailingZeros(mask_);
+          index_ += static_cast<std::size_t>(skipped) + 1;
+          mask_ >>= skipped;
+        }
+      }
+
+      // Reads and filters blocks, until one has selected elements, and moves
+      // to the first of those.
+      void FilterBlocks() {
+        auto end = range_.end();
+        while (true) {
+          block_.clear();
+          for (; block_.size() < kBatchSize && input_.Value() != end;
+               ++input_.Value()) {
+            block_.push_back(*input_.Value());
+          }
+          if (block_.empty()) {
+            is_done_ = true;
+            return;
+          }
+          RAMAN_STATS(CycleTimer timer(stats_.stats.cycles);)
+          mask_ = SelectBatch(filter(), block_.begin(), block_.end(),
+                              block_.size());
+          RAMAN_STATS(
+            ++stats_.stats.calls;
+            stats_.stats.elements_in += block_.size();
+            stats_.stats.elements_out += PopCount(mask_);
+          )
+          if (mask_ != 0) {
+            index_ = static_cast<std::size_t>(CountTrailingZeros(mask_));
+            mask_ >>= index_;
+            return;
+          }
+        }
+      }
+
+      Filter& filter() { return AssignableFunctor<Filter>::Get(); }
+
+      Range range_;
+      Optional<typename Range::iterator> input_;
+      std::vector<Value> block_;
+      std::size_t index_ = 0;
+      std::uint64_t mask_ = 0;
+      bool is_done_ = false;
+      RAMAN_STATS(StageCounter stats_{"WhereBatch"};)
+    };
+
+    template <typename Iterator>
+    struct SimpleRangeIterator {
+      // iterator typedefs.
+      using iterator_category = AdaptedCategory<Iterator>;
+      using value_type = typename std::iterator_traits<Iterator>::value_type;
+      using difference_type =
+          typename std::iterator_traits<Iterator>::difference_type;
+      using pointer = typename std::iterator_traits<Iterator>::pointer;
+      using reference = typename std::iterator_traits<Iterator>::reference;
+
+      constexpr explicit SimpleRangeIterator(Iterator iterator)
+        : iterator_(iterator) {}
+
+      SimpleRangeIterator(const SimpleRangeIterator&) = default;
+      SimpleRangeIterator& operator=(const SimpleRangeIterator&) = default;
+      SimpleRangeIterator(SimpleRangeIterator&&) = default;
+      SimpleRangeIterator& operator=(SimpleRangeIterator&&) = default;
+
+      constexpr SimpleRangeIterator& operator++() {
+        ++iterator_;
+        return *this;
+      }
+
+      constexpr SimpleRangeIterator& operator--() {
+        --iterator_;
+        return *this;
+      }
+
+     protected:
+      Iterator iterator_;
+    };
+
+    template <typename Range, typename Transformer>
+    struct ByValueTransformerRange : private AssignableFunctor<Transformer> {
+      constexpr explicit ByValueTransformerRange(Range range,
+                                                 Transformer transformer)
+        : AssignableFunctor<Transformer>(std::move(transformer)),
+          range_(std::move(range)) {}
+
+      ByValueTransformerRange(ByValueTransformerRange&&) = default;
+      ByValueTransformerRange& operator=(ByValueTransformerRange&&) = default;
+
+      struct iterator : SimpleRangeIterator<typename Range::iterator> {
+        // iterator typedefs.
+        using value_type = typename std::decay<
+            TransformedType<Range, Transformer>>::type;
+        using pointer = void;
+        using reference = value_type;
+
+        constexpr iterator(ByValueTransformerRange* const range,
+                 typename Range::iterator iterator)
+          : SimpleRangeIterator<typename Range::iterator>(std::move(iterator)),
+            range_(range) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr auto operator*() const {
+          RAMAN_ASSERT(this->iterator_ != range_->range_.end());
+          return range_->Apply(*this->iterator_);
+        }
+
+        constexpr auto operator->() const {
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && this->iterator_ == o.iterator_);
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        ByValueTransformerRange* range_;
+      };
+
+      constexpr bool operator==(const ByValueTransformerRange& o) const {
+        return (this->range_ == o.range_ &&
+                transformer() == o.transformer());
+      }
+
+      constexpr iterator begin() {
+        return iterator(this, range_.begin());
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.end());
+      }
+
+      // Fuses a following Transform() into this stage.
+      template <typename OtherTransformer>
+      constexpr auto Transform(OtherTransformer other) && {
+        using Composed = ComposedTransformer<Transformer, OtherTransformer>;
+        ByValueTransformerRange<Range, Composed> fused(
+            std::move(range_),
+            Composed(std::move(transformer()), std::move(other)));
+        RAMAN_STATS(fused.stats_ = std::move(stats_);)
+        return fused;
+      }
+
+      // Drops this stage, for ones which a following stage undoes.
+      constexpr Range Release() && {
+        RAMAN_STATS(stats_.Discard();)
+        return std::move(range_);
+      }
+
+     private:
+      template <typename Value>
+      constexpr decltype(auto) Apply(Value&& value) {
+        RAMAN_STATS(
+          CycleTimer timer(stats_.stats.cycles);
+          ++stats_.stats.calls;
+          ++stats_.stats.elements_in;
+          ++stats_.stats.elements_out;
+        )
+        return transformer()(std::forward<Value>(value));
+      }
+
+      constexpr Transformer& transformer() {
+        return AssignableFunctor<Transformer>::Get();
+      }
+      constexpr const Transformer& transformer() const {
+        return AssignableFunctor<Transformer>::Get();
+      }
+
+      Range range_;
+      RAMAN_STATS(StageCounter stats_{"Transform"};)
+      friend struct iterator;
+      template <typename, typename> friend struct ByValueTransformerRange;
+      template <typename, typename> friend struct ByRefTransformerRange;
+    };
+
+    // Transformer range.
+    template <typename Range, typename Transformer>
+    struct ByRefTransformerRange : private AssignableFunctor<Transformer> {
+      constexpr explicit ByRefTransformerRange(Range range,
+                                               Transformer transformer)
+        : AssignableFunctor<Transformer>(std::move(transformer)),
+          range_(std::move(range)) {}
+
+      ByRefTransformerRange(ByRefTransformerRange&&) = default;
+      ByRefTransformerRange& operator=(ByRefTransformerRange&&) = default;
+
+      struct iterator : SimpleRangeIterator<typename Range::iterator> {
+        // iterator typedefs.
+        using value_type = typename std::decay<
+            TransformedType<Range, Transformer>>::type;
+        using pointer = typename std::add_pointer<
+            TransformedType<Range, Transformer>>::type;
+        using reference = TransformedType<Range, Transformer>;
+
+        constexpr iterator(ByRefTransformerRange* const range,
+                 typename Range::iterator iterator)
+          : SimpleRangeIterator<typename Range::iterator>(std::move(iterator)),
+            range_(range) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr decltype(auto) operator*() const {
+          RAMAN_ASSERT(this->iterator_ != range_->range_.end());
+          return range_->Apply(*this->iterator_);
+        }
+
+        constexpr decltype(auto) operator->() const {
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (this->range_ == o.range_ && this->iterator_ == o.iterator_);
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        ByRefTransformerRange* range_;
+      };
+
+      constexpr bool operator==(const ByRefTransformerRange& o) const {
+        return (this->range_ == o.range_ &&
+                transformer() == o.transformer());
+      }
+
+      constexpr iterator begin() {
+        return iterator(this, range_.begin());
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.end());
+      }
+
+      // Fuses a following Transform() into a single by-value stage.
+      template <typename OtherTransformer>
+      constexpr auto Transform(OtherTransformer other) && {
+        using Composed = ComposedTransformer<Transformer, OtherTransformer>;
+        ByValueTransformerRange<Range, Composed> fused(
+            std::move(range_),
+            Composed(std::move(transformer()), std::move(other)));
+        RAMAN_STATS(fused.stats_ = std::move(stats_);)
+        return fused;
+      }
+
+      // Drops this stage, for ones which a following stage undoes.
+      constexpr Range Release() && {
+        RAMAN_STATS(stats_.Discard();)
+        return std::move(range_);
+      }
+
+     private:
+      template <typename Value>
+      constexpr decltype(auto) Apply(Value&& value) {
+        RAMAN_STATS(
+          CycleTimer timer(stats_.stats.cycles);
+          ++stats_.stats.calls;
+          ++stats_.stats.elements_in;
+          ++stats_.stats.elements_out;
+        )
+        return transformer()(std::forward<Value>(value));
+      }
+
+      constexpr Transformer& transformer() {
+        return AssignableFunctor<Transformer>::Get();
+      }
+      constexpr const Transformer& transformer() const {
+        return AssignableFunctor<Transformer>::Get();
+      }
+
+      Range range_;
+      RAMAN_STATS(StageCounter stats_{"Transform"};)
+      friend struct iterator;
+    };
+
+    template <typename T>
+    struct DereferenceFunctor {
+      DereferenceFunctor() = default;
+
+      DereferenceFunctor(const DereferenceFunctor&) = default;
+      DereferenceFunctor(DereferenceFunctor&&) = default;
+      DereferenceFunctor& operator=(const DereferenceFunctor&) = default;
+      DereferenceFunctor& operator=(DereferenceFunctor&&) = default;
+
+      constexpr decltype(auto) operator()(const T& t) const {
+        return *t;
+      }
+
+      constexpr bool operator==(const DereferenceFunctor& o) const {
+        return true;
+      }
+    };
+
+    template <typename T>
+    struct AddressOfFunctor {
+      constexpr T* operator()(T& t) const {
+        return &t;
+      }
+
+      constexpr bool operator==(const AddressOfFunctor& o) const {
+        return true;
+      }
+    };
+
+    template <typename Range>
+    struct DereferenceRange
+        : ByRefTransformerRange<Range,
+                                DereferenceFunctor<ReferenceType<Range>>> {
+      constexpr explicit DereferenceRange(Range range)
+        : ByRefTransformerRange<Range,
+                                DereferenceFunctor<ReferenceType<Range>>>(
+              std::move(range), DereferenceFunctor<ReferenceType<Range>>()) {}
+
+      DereferenceRange(DereferenceRange&&) = default;
+      DereferenceRange& operator=(DereferenceRange&&) = default;
+    };
+
+    template <typename Range>
+    struct ReverseRange {
+      constexpr explicit ReverseRange(Range range)
+        : range_(std::move(range)) {}
+
+      ReverseRange(ReverseRange&&) = default;
+      ReverseRange& operator=(ReverseRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename std::iterator_traits<
+            typename Range::iterator>::value_type;
+        using difference_type = typename std::iterator_traits<
+            typename Range::iterator>::difference_type;
+        using pointer = typename std::iterator_traits<
+            typename Range::iterator>::pointer;
+        using reference = typename std::iterator_traits<
+            typename Range::iterator>::reference;
+
+        constexpr explicit iterator(ReverseRange* const range,
+                          typename Range::iterator iterator,
+                          bool is_at_rend = false)
+          : range_(range),
+            iterator_(iterator),
+            is_at_rend_(is_at_rend) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr decltype(auto) operator*() const {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          RAMAN_ASSERT(!is_at_rend_);
+          return *iterator_;
+        }
+
+        constexpr decltype(auto) operator->() const {
+          return *this;
+        }
+
+        constexpr iterator& operator++() {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          RAMAN_ASSERT(!is_at_rend_);
+          if (iterator_ == range_->range_.begin()) {
+            is_at_rend_ = true;
+          } else {
+            --iterator_;
+          }
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          if (is_at_rend_) {
+            RAMAN_ASSERT(iterator_ == range_->range_.begin());
+            is_at_rend_ = false;
+          } else {
+            ++iterator_;
+            RAMAN_ASSERT(iterator_ != range_->range_.begin());
+          }
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ &&
+                  iterator_ == o.iterator_ &&
+                  is_at_rend_ == o.is_at_rend_);
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        ReverseRange* range_;
+        typename Range::iterator iterator_;
+        bool is_at_rend_;
+      };
+
+      constexpr bool operator==(const ReverseRange& o) const {
+        return (range_ == o.range_);
+      }
+
+      constexpr iterator begin() {
+        auto inner_it = range_.end();
+        if (inner_it == range_.begin()) {
+          return iterator(this, inner_it, true);
+        } else {
+          --inner_it;
+          return iterator(this, inner_it);
+        }
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.begin(), true);
+      }
+
+      // Reverse().Reverse() is a no-op.
+      constexpr Range Release() && {
+        return std::move(range_);
+      }
+
+     private:
+      Range range_;
+    };
+
+    // Skips elements equal to the one preceding them. Doesn't keep any state,
+    // so it may be walked in both directions.
+    template <typename Range, typename Comparator>
+    struct UniqueRange : private AssignableFunctor<Comparator> {
+      constexpr explicit UniqueRange(Range range, Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)),
+          range_(std::move(range)) {}
+
+      UniqueRange(UniqueRange&&) = default;
+      UniqueRange& operator=(UniqueRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = AdaptedCategory<typename Range::iterator>;
+        using value_type = typename std::iterator_traits<
+            typename Range::iterator>::value_type;
+        using difference_type = typename std::iterator_traits<
+            typename Range::iterator>::difference_type;
+        using pointer = typename std::iterator_traits<
+            typename Range::iterator>::pointer;
+        using reference = typename std::iterator_traits<
+            typename Range::iterator>::reference;
+
+        constexpr explicit iterator(UniqueRange* const range,
+                          typename Range::iterator iterator)
+          : range_(range),
+            iterator_(iterator) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr decltype(auto) operator*() const {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          return *iterator_;
+        }
+
+        constexpr decltype(auto) operator->() const {
+          return *this;
+        }
+
+        constexpr iterator& operator++() {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          auto previous = iterator_;
+          ++iterator_;
+          while (iterator_ != range_->range_.end() &&
+                 range_->comparator()(*previous, *iterator_)) {
+            previous = iterator_;
+            ++iterator_;
+          }
+          return *this;
+        }
+
+        // Moves to the first element of the previous group of equal elements.
+        constexpr iterator& operator--() {
+          RAMAN_ASSERT(iterator_ != range_->range_.begin());
+          --iterator_;
+          while (iterator_ != range_->range_.begin()) {
+            auto previous = iterator_;
+            --previous;
+            if (!range_->comparator()(*previous, *iterator_)) {
+              break;
+            }
+            iterator_ = previous;
+          }
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && iterator_ == o.iterator_);
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        UniqueRange* range_;
+        typename Range::iterator iterator_;
+      };
+
+      constexpr iterator begin() {
+        return iterator(this, range_.begin());
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.end());
+      }
+
+     private:
+      constexpr Comparator& comparator() {
+        return AssignableFunctor<Comparator>::Get();
+      }
+
+      Range range_;
+    };
+
+#ifdef RAMAN_ENABLE_STATS
+    // Passes elements through unchanged, while counting them along with the
+    // cycles spent producing them upstream.
+    template <typename Range>
+    struct ProbeRange {
+      explicit ProbeRange(Range range, const char* name, StageStats* output)
+        : range_(std::move(range)),
+          stats_(name, output) {}
+
+      ProbeRange(ProbeRange&&) = default;
+      ProbeRange& operator=(ProbeRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = AdaptedCategory<typename Range::iterator>;
+        using value_type = typename std::iterator_traits<
+            typename Range::iterator>::value_type;
+        using difference_type = typename std::iterator_traits<
+            typename Range::iterator>::difference_type;
+        using pointer = typename std::iterator_traits<
+            typename Range::iterator>::pointer;
+        using reference = typename std::iterator_traits<
+            typename Range::iterator>::reference;
+
+        explicit iterator(ProbeRange* range,
+                          typename Range::iterator iterator)
+          : range_(range),
+            iterator_(iterator) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        decltype(auto) operator*() const {
+          return *iterator_;
+        }
+
+        iterator& operator++() {
+          {
+            CycleTimer timer(range_->stats_.stats.cycles);
+            ++iterator_;
+          }
+          range_->CountIfNotAtEnd(iterator_);
+          return *this;
+        }
+
+        iterator& operator--() {
+          {
+            CycleTimer timer(range_->stats_.stats.cycles);
+            --iterator_;
+          }
+          range_->CountIfNotAtEnd(iterator_);
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && iterator_ == o.iterator_);
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        ProbeRange* range_;
+        typename Range::iterator iterator_;
+      };
+
+      iterator begin() {
+        auto inner = [this]() {
+          CycleTimer timer(stats_.stats.cycles);
+          return range_.begin();
+        }();
+        CountIfNotAtEnd(inner);
+        return iterator(this, std::move(inner));
+      }
+
+      iterator end() {
+        return iterator(this, range_.end());
+      }
+
+     private:
+      void CountIfNotAtEnd(const typename Range::iterator& iterator) {
+        if (iterator != range_.end()) {
+          ++stats_.stats.elements_in;
+          ++stats_.stats.elements_out;
+        }
+      }
+
+      Range range_;
+      StageCounter stats_;
+    };
+#endif
+
+    // Single-pass ranges can't revisit the previous element, so Unique()
+    // filters them while keeping a copy of it.
+    template <typename Value, typename Comparator>
+    struct UniqueFilter : private AssignableFunctor<Comparator> {
+      explicit UniqueFilter(Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)) {}
+
+      bool operator()(const Value& value) const {
+        if (!previous_.HasValue()) {
+          previous_.Emplace(value);
+          return true;
+        }
+        bool equals_previous = AssignableFunctor<Comparator>::Get()(
+            previous_.Value(), value);
+        previous_.Emplace(value);
+        return !equals_previous;
+      }
+
+      mutable Optional<Value> previous_;
+    };
+
+    // Stages which may stop before the end of the underlying range can't be
+    // walked backwards from there, so they are at most forward ranges.
+    template <typename Iterator>
+    using LimitedCategory = typename std::conditional<
+        std::is_base_of<std::forward_iterator_tag,
+                        IteratorCategory<Iterator>>::value,
+        std::forward_iterator_tag,
+        IteratorCategory<Iterator>>::type;
+
+    // Up to `count` elements of Range. The underlying iterator isn't advanced
+    // past the last of them, so single-pass ranges aren't read any further.
+    template <typename Range>
+    struct TakeRange {
+      constexpr explicit TakeRange(Range range, std::size_t count)
+        : range_(std::move(range)),
+          count_(count) {}
+
+      TakeRange(TakeRange&&) = default;
+      TakeRange& operator=(TakeRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = LimitedCategory<typename Range::iterator>;
+        using value_type = typename std::iterator_traits<
+            typename Range::iterator>::value_type;
+        using difference_type = typename std::iterator_traits<
+            typename Range::iterator>::difference_type;
+        using pointer = typename std::iterator_traits<
+            typename Range::iterator>::pointer;
+        using reference = typename std::iterator_traits<
+            typename Range::iterator>::reference;
+
+        constexpr iterator(TakeRange* range, typename Range::iterator iterator,
+                           std::size_t remaining)
+          : range_(range),
+            iterator_(std::move(iterator)),
+            remaining_(remaining) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr decltype(auto) operator*() const {
+          RAMAN_ASSERT(!IsEnd());
+          return *iterator_;
+        }
+
+        constexpr iterator& operator++() {
+          RAMAN_ASSERT(!IsEnd());
+          if (--remaining_ != 0) {
+            ++iterator_;
+          }
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && IsEnd() == o.IsEnd() &&
+                  (IsEnd() || iterator_ == o.iterator_));
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        constexpr bool IsEnd() const {
+          return remaining_ == 0 || iterator_ == range_->range_.end();
+        }
+
+        TakeRange* range_;
+        typename Range::iterator iterator_;
+        std::size_t remaining_;
+      };
+
+      constexpr iterator begin() {
+        if (count_ == 0) {
+          return end();
+        }
+        return iterator(this, range_.begin(), count_);
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.end(), 0);
+      }
+
+     private:
+      Range range_;
+      std::size_t count_;
+    };
+
+    // Elements of Range up to the first one rejected by Predicate.
+    template <typename Range, typename Predicate>
+    struct TakeWhileRange : private AssignableFunctor<Predicate> {
+      constexpr explicit TakeWhileRange(Range range, Predicate predicate)
+        : AssignableFunctor<Predicate>(std::move(predicate)),
+          range_(std::move(range)) {}
+
+      TakeWhileRange(TakeWhileRange&&) = default;
+      TakeWhileRange& operator=(TakeWhileRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = LimitedCategory<typename Range::iterator>;
+        using value_type = typename std::iterator_traits<
+            typename Range::iterator>::value_type;
+        using difference_type = typename std::iterator_traits<
+            typename Range::iterator>::difference_type;
+        using pointer = typename std::iterator_traits<
+            typename Range::iterator>::pointer;
+        using reference = typename std::iterator_traits<
+            typename Range::iterator>::reference;
+
+        constexpr iterator(TakeWhileRange* range,
+                           typename Range::iterator iterator)
+          : range_(range),
+            iterator_(std::move(iterator)) {
+          CheckPredicate();
+        }
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr decltype(auto) operator*() const {
+          RAMAN_ASSERT(!is_end_);
+          return *iterator_;
+        }
+
+        constexpr iterator& operator++() {
+          RAMAN_ASSERT(!is_end_);
+          ++iterator_;
+          CheckPredicate();
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && is_end_ == o.is_end_ &&
+                  (is_end_ || iterator_ == o.iterator_));
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        constexpr void CheckPredicate() {
+          is_end_ = (iterator_ == range_->range_.end() ||
+                     !range_->predicate()(*iterator_));
+        }
+
+        TakeWhileRange* range_;
+        typename Range::iterator iterator_;
+        bool is_end_ = false;
+      };
+
+      constexpr iterator begin() {
+        return iterator(this, range_.begin());
+      }
+
+      constexpr iterator end() {
+        return iterator(this, range_.end());
+      }
+
+     private:
+      constexpr Predicate& predicate() {
+        return AssignableFunctor<Predicate>::Get();
+      }
+
+      Range range_;
+    };
+
+    // Steps over up to `count` elements.
+    struct CountSkipper {
+      template <typename Iterator>
+      constexpr void operator()(Iterator& iterator, const Iterator& end) {
+        for (std::size_t i = 0; i < count && iterator != end; ++i) {
+          ++iterator;
+        }
+      }
+
+      std::size_t count;
+    };
+
+    // Steps over elements for as long as Predicate accepts them.
+    template <typename Predicate>
+    struct PredicateSkipper : private AssignableFunctor<Predicate> {
+      constexpr explicit PredicateSkipper(Predicate predicate)
+        : AssignableFunctor<Predicate>(std::move(predicate)) {}
+
+      template <typename Iterator>
+      constexpr void operator()(Iterator& iterator, const Iterator& end) {
+        while (iterator != end && AssignableFunctor<Predicate>::Get()(*iterator)) {
+          ++iterator;
+        }
+      }
+    };
+
+    // Elements of Range after those Skipper steps over. Skipping happens once,
+    // on the first call to begin(); the range keeps the traversal category
+    // of the underlying one.
+    template <typename Range, typename Skipper>
+    struct SkipRange : private AssignableFunctor<Skipper> {
+      using iterator = typename Range::iterator;
+
+      explicit SkipRange(Range range, Skipper skipper)
+        : AssignableFunctor<Skipper>(std::move(skipper)),
+          range_(std::move(range)) {}
+
+      SkipRange(SkipRange&& o)
+        : AssignableFunctor<Skipper>(std::move(o)),
+          range_(std::move(o.range_)) {
+        MoveBegin(o, MultiPass());
+      }
+      SkipRange& operator=(SkipRange&& o) {
+        AssignableFunctor<Skipper>::operator=(std::move(o));
+        range_ = std::move(o.range_);
+        begin_.Reset();
+        MoveBegin(o, MultiPass());
+        return *this;
+      }
+
+      iterator begin() {
+        if (!begin_.HasValue()) {
+          iterator it = range_.begin();
+          AssignableFunctor<Skipper>::Get()(it, range_.end());
+          begin_.Emplace(std::move(it));
+        }
+        return begin_.Value();
+      }
+
+      iterator end() { return range_.end(); }
+
+     private:
+      using MultiPass = std::integral_constant<
+          bool, HasCategory<std::forward_iterator_tag, Range>()>;
+
+      // The skipped-to iterator of a multi-pass range may point into the
+      // moved-from one (like into a container it owns), so the elements are
+      // skipped again, as std::views::drop does. Single-pass ranges can't
+      // go back, so they keep it.
+      void MoveBegin(SkipRange&, std::true_type /* multi-pass */) {}
+      void MoveBegin(SkipRange& o, std::false_type /* multi-pass */) {
+        if (o.begin_.HasValue()) {
+          begin_.Emplace(std::move(o.begin_.Value()));
+        }
+      }
+
+      Range range_;
+      Optional<iterator> begin_;
+    };
+
+    // Elements [offset, offset + count) of a random-access Range, which are
+    // found in O(1). Further Skip()s and Take()s narrow the same slice.
+    template <typename Range>
+    struct SliceRange {
+      using iterator = typename Range::iterator;
+
+      constexpr explicit SliceRange(Range range, std::size_t offset,
+                                    std::size_t count)
+        : range_(std::move(range)),
+          offset_(offset),
+          count_(count) {}
+
+      SliceRange(SliceRange&&) = default;
+      SliceRange& operator=(SliceRange&&) = default;
+
+      constexpr iterator begin() { return At(offset_); }
+      constexpr iterator end() { return At(offset_ + count_); }
+
+      constexpr SliceRange Skip(std::size_t count) && {
+        count = std::min(count, count_);
+        return SliceRange(std::move(range_), offset_ + count, count_ - count);
+      }
+
+      constexpr SliceRange Take(std::size_t count) && {
+        return SliceRange(std::move(range_), offset_, std::min(count, count_));
+      }
+
+     private:
+      // The iterator at `index`, or the end if the range is shorter.
+      constexpr iterator At(std::size_t index) {
+        iterator begin = range_.begin();
+        std::size_t size = static_cast<std::size_t>(range_.end() - begin);
+        return begin + static_cast<typename std::iterator_traits<
+            iterator>::difference_type>(std::min(index, size));
+      }
+
+      Range range_;
+      std::size_t offset_;
+      // Never makes offset_ + count_ overflow.
+      std::size_t count_;
+    };
+
+    // Merges Ranges sorted by Comparator into one sorted range, lazily: a heap
+    // of the ranges' next elements yields the first of them at each step, in
+    // O(log k) for k ranges, with O(k) memory. Elements which compare equal
+    // keep the order of their ranges. Like istream_iterator, it can only be
+    // iterated once.
+    template <typename Range, typename Comparator>
+    struct MergeRange : private AssignableFunctor<Comparator> {
+      explicit MergeRange(std::vector<Range> ranges, Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)),
+          ranges_(std::move(ranges)) {}
+
+      MergeRange(MergeRange&&) = default;
+      MergeRange& operator=(MergeRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::input_iterator_tag;
+        using value_type = StorableValueType<Range>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::add_pointer<ReferenceType<Range>>::type;
+        using reference = ReferenceType<Range>;
+
+        explicit iterator(MergeRange* range, bool is_end)
+          : range_(range),
+            is_end_(is_end) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        reference operator*() const {
+          RAMAN_ASSERT(!IsEnd());
+          return *range_->heap_.front().position;
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(!IsEnd());
+          range_->Advance();
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && IsEnd() == o.IsEnd());
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        bool IsEnd() const { return is_end_ || range_->heap_.empty(); }
+
+        MergeRange* range_;
+        bool is_end_;
+      };
+
+      iterator begin() {
+        if (!started_) {
+          started_ = true;
+          Start();
+        }
+        return iterator(this, false);
+      }
+
+      iterator end() { return iterator(this, true); }
+
+     private:
+      // Where a range is up to.
+      struct Cursor {
+        typename Range::iterator position;
+        typename Range::iterator end;
+        std::size_t index;
+      };
+
+      // Whether `a`'s next element comes before `b`'s.
+      bool Before(const Cursor& a, const Cursor& b) {
+        Comparator& comparator = AssignableFunctor<Comparator>::Get();
+        if (comparator(*a.position, *b.position)) {
+          return true;
+        }
+        return !comparator(*b.position, *a.position) && a.index < b.index;
+      }
+
+      void Start() {
+        heap_.reserve(ranges_.size());
+        for (std::size_t i = 0; i < ranges_.size(); ++i) {
+          auto position = ranges_[i].begin();
+          auto end = ranges_[i].end();
+          if (position != end) {
+            heap_.push_back(Cursor{std::move(position), std::move(end), i});
+          }
+        }
+        for (std::size_t i = heap_.size() / 2; i > 0; --i) {
+          SiftDown(i - 1);
+        }
+      }
+
+      // Moves past the first element, and restores the heap with a single
+      // sift-down (rather than a pop and a push).
+      void Advance() {
+        Cursor& top = heap_.front();
+        ++top.position;
+        if (top.position == top.end) {
+          top = std::move(heap_.back());
+          heap_.pop_back();
+        }
+        if (!heap_.empty()) {
+          SiftDown(0);
+        }
+      }
+
+      void SiftDown(std::size_t i) {
+        while (true) {
+          std::size_t first = i;
+          std::size_t left = 2 * i + 1;
+          std::size_t right = left + 1;
+          if (left < heap_.size() && Before(heap_[left], heap_[first])) {
+            first = left;
+          }
+          if (right < heap_.size() && Before(heap_[right], heap_[first])) {
+            first = right;
+          }
+          if (first == i) {
+            return;
+          }
+          std::swap(heap_[i], heap_[first]);
+          i = first;
+        }
+      }
+
+      std::vector<Range> ranges_;
+      std::vector<Cursor> heap_;
+      bool started_ = false;
+    };
+
+    // Like From(), for arguments of RamanWrapper methods: containers and
+    // wrappers given as rvalues are kept alive by the range, others are
+    // referred to.
+    template <typename Container>
+    constexpr auto ToRange(Container& container) {
+      return SimpleRange<decltype(container.begin())>(container.begin(),
+                                                      container.end());
+    }
+    template <typename Container>
+    constexpr auto ToRange(Container&& container) {
+      return SimpleRangeOwner<Container>(std::move(container));
+    }
+
+    // Moves `it` to the first element in [it, end) not ordered before
+    // `value`. Random-access ranges are searched with galloping (exponential)
+    // search, which takes O(log d) comparisons to skip d elements, so that
+    // walking a small range against a large one is fast.
+    template <typename Iterator, typename Value, typename Comparator>
+    constexpr Iterator SkipBefore(Iterator it, const Iterator& end,
+                                  const Value& value, Comparator& comparator,
+                                  std::true_type /* random access */) {
+      auto size = end - it;
+      decltype(size) bound = 1;
+      while (bound < size && comparator(it[bound], value)) {
+        bound *= 2;
+      }
+      // it[bound / 2] is known to be before `value` (it[0] isn't checked, so
+      // this also works if it's not).
+      Iterator low = bound == 1 ? it : it + (bound / 2 + 1);
+      Iterator high = bound < size ? it + (bound + 1) : end;
+      return std::lower_bound(low, high, value,
+                              [&comparator](const auto& a, const auto& b) {
+                                return comparator(a, b);
+                              });
+    }
+    template <typename Iterator, typename Value, typename Comparator>
+    constexpr Iterator SkipBefore(Iterator it, const Iterator& end,
+                                  const Value& value, Comparator& comparator,
+                                  std::false_type /* random access */) {
+      while (it != end && comparator(*it, value)) {
+        ++it;
+      }
+      return it;
+    }
+    template <typename Iterator, typename Value, typename Comparator>
+    constexpr Iterator SkipBefore(Iterator it, const Iterator& end,
+                                  const Value& value, Comparator& comparator) {
+      return SkipBefore(std::move(it), end, value, comparator,
+                        std::integral_constant<
+                            bool, std::is_base_of<
+                                std::random_access_iterator_tag,
+                                IteratorCategory<Iterator>>::value>());
+    }
+
+    // Set operations on ranges sorted by Comparator, with the semantics of
+    // std::set_intersection() and friends.
+    enum class SetOperation {
+      kIntersect,
+      kUnion,
+      kExcept,
+      kSymmetricDifference,
+    };
+
+    // Applies Operation to two sorted ranges, walking them in lockstep
+    // without buffering.
+    template <typename Left, typename Right, typename Comparator,
+              SetOperation kOperation>
+    struct SetOperationRange : private AssignableFunctor<Comparator> {
+      constexpr explicit SetOperationRange(Left left, Right right,
+                                           Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)),
+          left_(std::move(left)),
+          right_(std::move(right)) {}
+
+      SetOperationRange(SetOperationRange&&) = default;
+      SetOperationRange& operator=(SetOperationRange&&) = default;
+
+      // Intersect() and Except() only produce elements of the left range;
+      // the others produce elements of both, by value unless they agree.
+      using LeftOnly = std::integral_constant<
+          bool, kOperation == SetOperation::kIntersect ||
+                kOperation == SetOperation::kExcept>;
+      using Reference = typename std::conditional<
+          LeftOnly::value ||
+              std::is_same<ReferenceType<Left>, ReferenceType<Right>>::value,
+          ReferenceType<Left>,
+          typename std::common_type<ReferenceType<Left>,
+                                    ReferenceType<Right>>::type>::type;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = typename std::conditional<
+            HasCategory<std::forward_iterator_tag, Left>() &&
+                HasCategory<std::forward_iterator_tag, Right>(),
+            std::forward_iterator_tag, std::input_iterator_tag>::type;
+        using value_type = typename std::decay<Reference>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::add_pointer<Reference>::type;
+        using reference = Reference;
+
+        constexpr iterator(SetOperationRange* range,
+                           typename Left::iterator left,
+                           typename Right::iterator right)
+          : range_(range),
+            left_(std::move(left)),
+            right_(std::move(right)) {
+          Settle();
+        }
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          RAMAN_ASSERT(!IsLeftEnd() || !IsRightEnd());
+          return Current(LeftOnly());
+        }
+
+        constexpr iterator& operator++() {
+          RAMAN_ASSERT(!IsLeftEnd() || !IsRightEnd());
+          if (side_ != Side::kRight) {
+            ++left_;
+          }
+          if (side_ != Side::kLeft) {
+            ++right_;
+          }
+          Settle();
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && left_ == o.left_ &&
+                  right_ == o.right_);
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        constexpr reference Current(std::true_type /* left only */) const {
+          return *left_;
+        }
+        constexpr reference Current(std::false_type /* left only */) const {
+          if (side_ == Side::kRight) {
+            return *right_;
+          }
+          return *left_;
+        }
+
+        // Where the current element comes from. kBoth means both ranges have
+        // an equivalent element, and both are moved past it.
+        enum class Side { kLeft, kRight, kBoth };
+
+        constexpr bool IsLeftEnd() const {
+          return left_ == range_->left_.end();
+        }
+        constexpr bool IsRightEnd() const {
+          return right_ == range_->right_.end();
+        }
+
+        // Moves to the next element the operation produces, if it's not the
+        // current one.
+        constexpr void Settle() {
+          Comparator& comparator = range_->comparator();
+          while (!IsLeftEnd() || !IsRightEnd()) {
+            if (IsRightEnd()) {
+              if (kOperation == SetOperation::kIntersect) {
+                left_ = range_->left_.end();
+                return;
+              }
+              side_ = Side::kLeft;
+              return;
+            }
+            if (IsLeftEnd()) {
+              if (kOperation == SetOperation::kIntersect ||
+                  kOperation == SetOperation::kExcept) {
+                right_ = range_->right_.end();
+                return;
+              }
+              side_ = Side::kRight;
+              return;
+            }
+            if (comparator(*left_, *right_)) {
+              if (kOperation == SetOperation::kIntersect) {
+                left_ = SkipBefore(std::move(left_), range_->left_.end(),
+                                   *right_, comparator);
+                continue;
+              }
+              side_ = Side::kLeft;
+              return;
+            }
+            if (comparator(*right_, *left_)) {
+              if (kOperation == SetOperation::kIntersect ||
+                  kOperation == SetOperation::kExcept) {
+                right_ = SkipBefore(std::move(right_), range_->right_.end(),
+                                    *left_, comparator);
+                continue;
+              }
+              side_ = Side::kRight;
+              return;
+            }
+            // Equivalent elements.
+            if (kOperation == SetOperation::kIntersect ||
+                kOperation == SetOperation::kUnion) {
+              side_ = Side::kBoth;
+              return;
+            }
+            ++left_;
+            ++right_;
+          }
+        }
+
+        SetOperationRange* range_;
+        typename Left::iterator left_;
+        typename Right::iterator right_;
+        Side side_ = Side::kLeft;
+      };
+
+      constexpr iterator begin() {
+        return iterator(this, left_.begin(), right_.begin());
+      }
+
+      constexpr iterator end() {
+        return iterator(this, left_.end(), right_.end());
+      }
+
+     private:
+      constexpr Comparator& comparator() {
+        return AssignableFunctor<Comparator>::Get();
+      }
+
+      Left left_;
+      Right right_;
+    };
+
+    // Zipped ranges are walked in lockstep, so together they support only
+    // what all of them do. The end of the shortest one can't be found from
+    // the others' ends without random access, so zips of other ranges can't
+    // be walked backwards.
+    template <typename... Ranges>
+    using ZipCategory = typename std::conditional<
+        And(HasCategory<std::random_access_iterator_tag, Ranges>()...),
+        std::random_access_iterator_tag,
+        typename std::conditional<
+            And(HasCategory<std::forward_iterator_tag, Ranges>()...),
+            std::forward_iterator_tag,
+            std::input_iterator_tag>::type>::type;
+
+    // Elements of Ranges side by side, up to the end of the shortest one.
+    // Each element is a tuple of the ranges' references, so nothing is
+    // copied, and assigning to its members writes to the ranges.
+    template <typename... Ranges>
+    struct ZipRange {
+      using Indices = std::index_sequence_for<Ranges...>;
+      using RandomAccess = std::integral_constant<
+          bool, std::is_same<ZipCategory<Ranges...>,
+                             std::random_access_iterator_tag>::value>;
+
+      constexpr explicit ZipRange(Ranges... ranges)
+        : ranges_(std::move(ranges)...) {}
+
+      ZipRange(ZipRange&&) = default;
+      ZipRange& operator=(ZipRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = ZipCategory<Ranges...>;
+        using value_type = std::tuple<StorableValueType<Ranges>...>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::tuple<ReferenceType<Ranges>...>;
+
+        constexpr explicit iterator(
+            std::tuple<typename Ranges::iterator...> iterators)
+          : iterators_(std::move(iterators)) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          return Dereference(Indices());
+        }
+        constexpr reference operator[](difference_type n) const {
+          return *(*this + n);
+        }
+
+        constexpr iterator& operator++() {
+          Increment(Indices());
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          Decrement(Indices());
+          return *this;
+        }
+
+        constexpr iterator& operator+=(difference_type n) {
+          Advance(n, Indices());
+          return *this;
+        }
+
+        constexpr iterator& operator-=(difference_type n) {
+          Advance(-n, Indices());
+          return *this;
+        }
+
+        constexpr iterator operator+(difference_type n) const {
+          iterator result = *this;
+          return result += n;
+        }
+
+        friend constexpr iterator operator+(difference_type n,
+                                            const iterator& it) {
+          return it + n;
+        }
+
+        constexpr iterator operator-(difference_type n) const {
+          iterator result = *this;
+          return result -= n;
+        }
+
+        // Zipped iterators move together, so the first one tells positions.
+        constexpr difference_type operator-(const iterator& o) const {
+          return std::get<0>(iterators_) - std::get<0>(o.iterators_);
+        }
+
+        // The end() of random-access zips is where the shortest range ends,
+        // in all ranges. Otherwise, iterators are equal if any of their
+        // ranges' are, which makes them equal to end() once the shortest
+        // range is exhausted.
+        constexpr bool operator==(const iterator& o) const {
+          return RandomAccess::value
+                     ? std::get<0>(iterators_) == std::get<0>(o.iterators_)
+                     : AnyEqual(o, Indices());
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+        constexpr bool operator<(const iterator& o) const {
+          return std::get<0>(iterators_) < std::get<0>(o.iterators_);
+        }
+
+        constexpr bool operator>(const iterator& o) const {
+          return o < *this;
+        }
+
+        constexpr bool operator<=(const iterator& o) const {
+          return !(o < *this);
+        }
+
+        constexpr bool operator>=(const iterator& o) const {
+          return !(*this < o);
+        }
+
+       private:
+        template <std::size_t... kIndices>
+        constexpr reference Dereference(
+            std::index_sequence<kIndices...>) const {
+          return reference(*std::get<kIndices>(iterators_)...);
+        }
+
+        template <std::size_t... kIndices>
+        constexpr void Increment(std::index_sequence<kIndices...>) {
+          int unused[] = {0, (++std::get<kIndices>(iterators_), 0)...};
+          (void)unused;
+        }
+
+        template <std::size_t... kIndices>
+        constexpr void Decrement(std::index_sequence<kIndices...>) {
+          int unused[] = {0, (--std::get<kIndices>(iterators_), 0)...};
+          (void)unused;
+        }
+
+        template <std::size_t... kIndices>
+        constexpr void Advance(difference_type n,
+                               std::index_sequence<kIndices...>) {
+          int unused[] = {0, (std::get<kIndices>(iterators_) += n, 0)...};
+          (void)unused;
+        }
+
+        template <std::size_t... kIndices>
+        constexpr bool AnyEqual(const iterator& o,
+                                std::index_sequence<kIndices...>) const {
+          return !And(std::get<kIndices>(iterators_) !=
+                      std::get<kIndices>(o.iterators_)...);
+        }
+
+        std::tuple<typename Ranges::iterator...> iterators_;
+      };
+
+      constexpr iterator begin() {
+        return Begin(Indices());
+      }
+
+      constexpr iterator end() {
+        return End(Indices(), RandomAccess());
+      }
+
+     private:
+      template <std::size_t... kIndices>
+      constexpr iterator Begin(std::index_sequence<kIndices...>) {
+        return iterator(
+            std::make_tuple(std::get<kIndices>(ranges_).begin()...));
+      }
+
+      // The end of the shortest range, in the others too.
+      template <std::size_t... kIndices>
+      constexpr iterator End(std::index_sequence<kIndices...>,
+                             std::true_type /* random access */) {
+        std::ptrdiff_t size = std::numeric_limits<std::ptrdiff_t>::max();
+        int unused[] = {0, (size = std::min<std::ptrdiff_t>(
+                                size, std::get<kIndices>(ranges_).end() -
+                                          std::get<kIndices>(ranges_).begin()),
+                            0)...};
+        (void)unused;
+        return begin() + size;
+      }
+      template <std::size_t... kIndices>
+      constexpr iterator End(std::index_sequence<kIndices...>,
+                             std::false_type /* random access */) {
+        return iterator(std::make_tuple(std::get<kIndices>(ranges_).end()...));
+      }
+
+      std::tuple<Ranges...> ranges_;
+    };
+
+    // Elements of Range along with their position, as (index, reference)
+    // pairs. Like ZipRange, it is random-access if Range is, and at most
+    // forward otherwise.
+    template <typename Range>
+    struct EnumerateRange {
+      using RandomAccess = std::integral_constant<
+          bool, HasCategory<std::random_access_iterator_tag, Range>()>;
+
+      constexpr explicit EnumerateRange(Range range)
+        : range_(std::move(range)) {}
+
+      EnumerateRange(EnumerateRange&&) = default;
+      EnumerateRange& operator=(EnumerateRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = typename std::conditional<
+            RandomAccess::value, std::random_access_iterator_tag,
+            LimitedCategory<typename Range::iterator>>::type;
+        using value_type = std::pair<std::size_t, StorableValueType<Range>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::pair<std::size_t, ReferenceType<Range>>;
+
+        constexpr iterator(typename Range::iterator iterator, std::size_t index)
+          : iterator_(std::move(iterator)),
+            index_(index) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          return reference(index_, *iterator_);
+        }
+        constexpr reference operator[](difference_type n) const {
+          return *(*this + n);
+        }
+
+        constexpr iterator& operator++() {
+          ++iterator_;
+          ++index_;
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          --iterator_;
+          --index_;
+          return *this;
+        }
+
+        constexpr iterator& operator+=(difference_type n) {
+          iterator_ += n;
+          index_ += n;
+          return *this;
+        }
+
+        constexpr iterator& operator-=(difference_type n) {
+          iterator_ -= n;
+          index_ -= n;
+          return *this;
+        }
+
+        constexpr iterator operator+(difference_type n) const {
+          return iterator(iterator_ + n, index_ + n);
+        }
+
+        friend constexpr iterator operator+(difference_type n,
+                                            const iterator& it) {
+          return it + n;
+        }
+
+        constexpr iterator operator-(difference_type n) const {
+          return iterator(iterator_ - n, index_ - n);
+        }
+
+        constexpr difference_type operator-(const iterator& o) const {
+          return iterator_ - o.iterator_;
+        }
+
+        // The index of end() isn't known, so only the iterators are compared.
+        constexpr bool operator==(const iterator& o) const {
+          return iterator_ == o.iterator_;
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return iterator_ != o.iterator_;
+        }
+
+        constexpr bool operator<(const iterator& o) const {
+          return iterator_ < o.iterator_;
+        }
+
+        constexpr bool operator>(const iterator& o) const {
+          return o < *this;
+        }
+
+        constexpr bool operator<=(const iterator& o) const {
+          return !(o < *this);
+        }
+
+        constexpr bool operator>=(const iterator& o) const {
+          return !(*this < o);
+        }
+
+       private:
+        typename Range::iterator iterator_;
+        std::size_t index_;
+      };
+
+      constexpr iterator begin() { return iterator(range_.begin(), 0); }
+
+      // Walking backwards from end() needs its index.
+      constexpr iterator end() { return End(RandomAccess()); }
+
+     private:
+      constexpr iterator End(std::true_type /* random access */) {
+        typename Range::iterator begin = range_.begin();
+        typename Range::iterator end = range_.end();
+        return iterator(end, static_cast<std::size_t>(end - begin));
+      }
+      constexpr iterator End(std::false_type /* random access */) {
+        return iterator(range_.end(), 0);
+      }
+
+      Range range_;
+    };
+
+    // The weaker of two iterator categories.
+    template <typename First, typename Second>
+    using WeakerCategory = typename std::conditional<
+        std::is_base_of<First, Second>::value, First, Second>::type;
+
+    // The weakest of the categories of Iterators, as adapted by stages which
+    // step through them with ++ and --.
+    template <typename Iterator, typename... Rest>
+    struct WeakestCategory {
+      using Type = WeakerCategory<AdaptedCategory<Iterator>,
+                                  typename WeakestCategory<Rest...>::Type>;
+    };
+    template <typename Iterator>
+    struct WeakestCategory<Iterator> {
+      using Type = AdaptedCategory<Iterator>;
+    };
+
+    template <std::size_t kIndex>
+    using Index = std::integral_constant<std::size_t, kIndex>;
+
+    // Returns function(Index<index>()), for index < kCount: turns a run-time
+    // index into a compile-time one, for use with std::get().
+    template <std::size_t kCount, typename Function, std::size_t kIndex = 0>
+    constexpr decltype(auto) VisitIndex(std::size_t index, Function&& function,
+                                        Index<kIndex> = Index<0>()) {
+      return VisitIndex<kCount>(
+          index, function, Index<kIndex>(),
+          std::integral_constant<bool, (kIndex + 1 < kCount)>());
+    }
+    template <std::size_t kCount, typename Function, std::size_t kIndex>
+    constexpr decltype(auto) VisitIndex(std::size_t index, Function& function,
+                                        Index<kIndex>,
+                                        std::true_type /* more indices */) {
+      if (index == kIndex) {
+        return function(Index<kIndex>());
+      }
+      return VisitIndex<kCount>(index, function, Index<kIndex + 1>());
+    }
+    template <std::size_t kCount, typename Function, std::size_t kIndex>
+    constexpr decltype(auto) VisitIndex(std::size_t index, Function& function,
+                                        Index<kIndex>,
+                                        std::false_type /* more indices */) {
+      RAMAN_ASSERT(index == kIndex);
+      return function(Index<kIndex>());
+    }
+
+    // Elements of Ranges, one range after the other. Empty ranges are stepped
+    // over when moving between ranges, so iterators always point at an
+    // element or at the end of the last range.
+    template <typename... Ranges>
+    struct ConcatRange {
+      static_assert(sizeof...(Ranges) > 0, "Nothing to concatenate");
+      using First = typename std::tuple_element<0, std::tuple<Ranges...>>::type;
+      // By value, unless all ranges agree on the reference type.
+      using Reference = typename std::conditional<
+          And(std::is_same<ReferenceType<First>,
+                           ReferenceType<Ranges>>::value...),
+          ReferenceType<First>,
+          typename std::common_type<ReferenceType<Ranges>...>::type>::type;
+
+      constexpr explicit ConcatRange(Ranges... ranges)
+        : ranges_(std::move(ranges)...) {}
+
+      ConcatRange(ConcatRange&&) = default;
+      ConcatRange& operator=(ConcatRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category =
+            typename WeakestCategory<typename Ranges::iterator...>::Type;
+        using value_type = typename std::decay<Reference>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Reference;
+
+        constexpr iterator(ConcatRange* range,
+                           std::tuple<typename Ranges::iterator...> iterators,
+                           std::size_t active)
+          : range_(range),
+            iterators_(std::move(iterators)),
+            active_(active) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          return VisitIndex<sizeof...(Ranges)>(
+              active_, [this](auto index) -> reference {
+                RAMAN_ASSERT(!IsEnd(index));
+                return *std::get<decltype(index)::value>(iterators_);
+              });
+        }
+
+        constexpr iterator& operator++() {
+          VisitIndex<sizeof...(Ranges)>(active_, [this](auto index) {
+            RAMAN_ASSERT(!IsEnd(index));
+            ++std::get<decltype(index)::value>(iterators_);
+          });
+          SkipEnded();
+          return *this;
+        }
+
+        // Earlier ranges' iterators are at their end, from walking past them
+        // or from end().
+        constexpr iterator& operator--() {
+          while (VisitIndex<sizeof...(Ranges)>(
+                     active_, [this](auto index) { return IsBegin(index); })) {
+            RAMAN_ASSERT(active_ != 0);
+            --active_;
+          }
+          VisitIndex<sizeof...(Ranges)>(active_, [this](auto index) {
+            --std::get<decltype(index)::value>(iterators_);
+          });
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && active_ == o.active_ &&
+                  VisitIndex<sizeof...(Ranges)>(active_, [&](auto index) {
+                    constexpr std::size_t kIndex = decltype(index)::value;
+                    return std::get<kIndex>(iterators_) ==
+                           std::get<kIndex>(o.iterators_);
+                  }));
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        friend struct ConcatRange;
+
+        // Moves on from ranges which ended, except for the last one.
+        constexpr void SkipEnded() {
+          while (active_ + 1 < sizeof...(Ranges) &&
+                 VisitIndex<sizeof...(Ranges)>(
+                     active_, [this](auto index) { return IsEnd(index); })) {
+            ++active_;
+          }
+        }
+
+        template <std::size_t kIndex>
+        constexpr bool IsBegin(Index<kIndex>) const {
+          return std::get<kIndex>(iterators_) ==
+                 std::get<kIndex>(range_->ranges_).begin();
+        }
+
+        template <std::size_t kIndex>
+        constexpr bool IsEnd(Index<kIndex>) const {
+          return std::get<kIndex>(iterators_) ==
+                 std::get<kIndex>(range_->ranges_).end();
+        }
+
+        ConcatRange* range_;
+        std::tuple<typename Ranges::iterator...> iterators_;
+        // The range iterators_ currently walks.
+        std::size_t active_;
+      };
+
+      constexpr iterator begin() {
+        iterator begin(this, Begins(Indices()), 0);
+        begin.SkipEnded();
+        return begin;
+      }
+
+      constexpr iterator end() {
+        return iterator(this, Ends(Indices()), sizeof...(Ranges) - 1);
+      }
+
+     private:
+      using Indices = std::index_sequence_for<Ranges...>;
+
+      template <std::size_t... kIndices>
+      constexpr auto Begins(std::index_sequence<kIndices...>) {
+        return std::make_tuple(std::get<kIndices>(ranges_).begin()...);
+      }
+
+      template <std::size_t... kIndices>
+      constexpr auto Ends(std::index_sequence<kIndices...>) {
+        return std::make_tuple(std::get<kIndices>(ranges_).end()...);
+      }
+
+      std::tuple<Ranges...> ranges_;
+    };
+
+    // Returns its argument, like std::identity.
+    struct IdentityFunctor {
+      template <typename T>
+      constexpr T&& operator()(T&& t) const {
+        return std::forward<T>(t);
+      }
+
+      constexpr bool operator==(const IdentityFunctor&) const {
+        return true;
+      }
+    };
+
+    // Elements of the inner ranges Mapper returns for elements of Range, one
+    // inner range after the other. Inner ranges returned by reference are
+    // walked in place, and may be walked backwards; see the specialization
+    // below for ones returned by value.
+    template <typename Range, typename Mapper,
+              bool kByReference = std::is_lvalue_reference<
+                  TransformedType<Range, Mapper>>::value>
+    struct FlatMapRange : private AssignableFunctor<Mapper> {
+      using Inner =
+          typename std::remove_reference<TransformedType<Range, Mapper>>::type;
+      using InnerIterator = decltype(std::declval<Inner&>().begin());
+
+      constexpr explicit FlatMapRange(Range range, Mapper mapper)
+        : AssignableFunctor<Mapper>(std::move(mapper)),
+          range_(std::move(range)) {}
+
+      FlatMapRange(FlatMapRange&&) = default;
+      FlatMapRange& operator=(FlatMapRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category =
+            typename WeakestCategory<typename Range::iterator,
+                                     InnerIterator>::Type;
+        using value_type =
+            typename std::iterator_traits<InnerIterator>::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::iterator_traits<InnerIterator>::pointer;
+        using reference = decltype(*std::declval<InnerIterator&>());
+
+        // Inner iterators are left value-initialized at the end.
+        constexpr iterator(FlatMapRange* range,
+                           typename Range::iterator outer)
+          : range_(range),
+            outer_(std::move(outer)) {
+          Enter();
+        }
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          RAMAN_ASSERT(outer_ != range_->range_.end());
+          return *inner_;
+        }
+
+        constexpr iterator& operator++() {
+          RAMAN_ASSERT(outer_ != range_->range_.end());
+          if (++inner_ == inner_end_) {
+            ++outer_;
+            Enter();
+          }
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          if (outer_ == range_->range_.end() || inner_ == inner().begin()) {
+            do {
+              --outer_;
+            } while (inner().begin() == inner().end());
+            inner_end_ = inner().end();
+            inner_ = inner_end_;
+          }
+          --inner_;
+          return *this;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && outer_ == o.outer_ &&
+                  (outer_ == range_->range_.end() || inner_ == o.inner_));
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        // Moves to the first element of the first non-empty inner range,
+        // from outer_ on.
+        constexpr void Enter() {
+          for (; outer_ != range_->range_.end(); ++outer_) {
+            inner_ = inner().begin();
+            inner_end_ = inner().end();
+            if (inner_ != inner_end_) {
+              return;
+            }
+          }
+        }
+
+        constexpr Inner& inner() const { return range_->mapper()(*outer_); }
+
+        FlatMapRange* range_;
+        typename Range::iterator outer_;
+        InnerIterator inner_{};
+        InnerIterator inner_end_{};
+      };
+
+      constexpr iterator begin() { return iterator(this, range_.begin()); }
+      constexpr iterator end() { return iterator(this, range_.end()); }
+
+     private:
+      constexpr Mapper& mapper() { return AssignableFunctor<Mapper>::Get(); }
+
+      Range range_;
+    };
+
+    // Inner ranges returned by value, like wrappers, are held by the range
+    // while they are walked, so this is a single-pass range.
+    template <typename Range, typename Mapper>
+    struct FlatMapRange<Range, Mapper, false>
+        : private AssignableFunctor<Mapper> {
+      using Inner =
+          typename std::decay<TransformedType<Range, Mapper>>::type;
+      using InnerIterator = decltype(std::declval<Inner&>().begin());
+
+      explicit FlatMapRange(Range range, Mapper mapper)
+        : AssignableFunctor<Mapper>(std::move(mapper)),
+          range_(std::move(range)) {}
+
+      FlatMapRange(FlatMapRange&&) = default;
+      FlatMapRange& operator=(FlatMapRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::input_iterator_tag;
+        using value_type =
+            typename std::iterator_traits<InnerIterator>::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::iterator_traits<InnerIterator>::pointer;
+        using reference = decltype(*std::declval<InnerIterator&>());
+
+        explicit iterator(FlatMapRange* range, bool is_end)
+          : range_(range),
+            is_end_(is_end) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        reference operator*() const {
+          RAMAN_ASSERT(!IsEnd());
+          return *range_->inner_iterator_.Value();
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(!IsEnd());
+          range_->Advance();
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && IsEnd() == o.IsEnd());
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        bool IsEnd() const { return is_end_ || range_->IsEnd(); }
+
+        FlatMapRange* range_;
+        bool is_end_;
+      };
+
+      iterator begin() {
+        outer_.Emplace(range_.begin());
+        Enter();
+        return iterator(this, false);
+      }
+
+      iterator end() { return iterator(this, true); }
+
+     private:
+      void Advance() {
+        if (++inner_iterator_.Value() == inner_end_.Value()) {
+          ++outer_.Value();
+          Enter();
+        }
+      }
+
+      // Maps elements from outer_ on, until one maps to a non-empty range.
+      void Enter() {
+        for (; !IsEnd(); ++outer_.Value()) {
+          inner_.Emplace(mapper()(*outer_.Value()));
+          inner_iterator_.Emplace(inner_.Value().begin());
+          inner_end_.Emplace(inner_.Value().end());
+          if (inner_iterator_.Value() != inner_end_.Value()) {
+            return;
+          }
+        }
+      }
+
+      bool IsEnd() { return outer_.Value() == range_.end(); }
+
+      Mapper& mapper() { return AssignableFunctor<Mapper>::Get(); }
+
+      Range range_;
+      Optional<typename Range::iterator> outer_;
+      Optional<Inner> inner_;
+      Optional<InnerIterator> inner_iterator_;
+      Optional<InnerIterator> inner_end_;
+    };
+
+    // `size` consecutive elements of a range, as yielded by Window(): a
+    // view referring to them, like a pair of iterators.
+    template <typename Iterator>
+    struct WindowView {
+      using iterator = Iterator;
+
+      constexpr WindowView(Iterator begin, Iterator end, std::size_t size)
+        : begin_(std::move(begin)),
+          end_(std::move(end)),
+          size_(size) {}
+
+      constexpr iterator begin() const { return begin_; }
+      constexpr iterator end() const { return end_; }
+      constexpr std::size_t size() const { return size_; }
+
+      constexpr decltype(auto) front() const { return *begin_; }
+      // Bidirectional ranges only.
+      constexpr decltype(auto) back() const { return *std::prev(end_); }
+      // Random-access ranges only.
+      constexpr decltype(auto) operator[](std::size_t index) const {
+        return begin_[static_cast<std::ptrdiff_t>(index)];
+      }
+
+     private:
+      Iterator begin_;
+      Iterator end_;
+      std::size_t size_;
+    };
+
+    // Stages whose elements refer to several elements of Range need it to
+    // be multi-pass. They are random-access if Range is, as they implement
+    // all of its operations, and forward otherwise: finding where they end
+    // from the end would take walking backwards over several elements.
+    template <typename Range>
+    using MultiPassCategory = typename std::conditional<
+        HasCategory<std::random_access_iterator_tag, Range>(),
+        std::random_access_iterator_tag, std::forward_iterator_tag>::type;
+
+    // Views of each `size` consecutive elements of Range, each a step further
+    // than the previous one. Iterators hold the first and last elements of
+    // their window, and move both at each step, so nothing is buffered.
+    template <typename Range>
+    struct WindowRange {
+      using RandomAccess = std::integral_constant<
+          bool, HasCategory<std::random_access_iterator_tag, Range>()>;
+      using Iterator = typename Range::iterator;
+
+      constexpr explicit WindowRange(Range range, std::size_t size)
+        : range_(std::move(range)),
+          size_(size) {
+        RAMAN_ASSERT(size > 0);
+      }
+
+      WindowRange(WindowRange&&) = default;
+      WindowRange& operator=(WindowRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = MultiPassCategory<Range>;
+        using value_type = WindowView<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = WindowView<Iterator>;
+
+        // `last` is past the end for iterators past the last window.
+        constexpr iterator(Iterator first, Iterator last, std::size_t size)
+          : first_(std::move(first)),
+            last_(std::move(last)),
+            size_(size) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          return reference(first_, std::next(last_), size_);
+        }
+        constexpr reference operator[](difference_type n) const {
+          return *(*this + n);
+        }
+
+        constexpr iterator& operator++() {
+          ++first_;
+          ++last_;
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          --first_;
+          --last_;
+          return *this;
+        }
+
+        constexpr iterator& operator+=(difference_type n) {
+          first_ += n;
+          last_ += n;
+          return *this;
+        }
+
+        constexpr iterator& operator-=(difference_type n) {
+          first_ -= n;
+          last_ -= n;
+          return *this;
+        }
+
+        constexpr iterator operator+(difference_type n) const {
+          return iterator(first_ + n, last_ + n, size_);
+        }
+
+        constexpr iterator operator-(difference_type n) const {
+          return iterator(first_ - n, last_ - n, size_);
+        }
+
+        constexpr difference_type operator-(const iterator& o) const {
+          return last_ - o.last_;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return last_ == o.last_;
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return last_ != o.last_;
+        }
+
+        constexpr bool operator<(const iterator& o) const {
+          return last_ < o.last_;
+        }
+
+       private:
+        Iterator first_;
+        Iterator last_;
+        std::size_t size_;
+      };
+
+      // Ranges shorter than size_ have no windows: their last_ is end().
+      constexpr iterator begin() {
+        Iterator first = range_.begin();
+        Iterator last = first;
+        Iterator end = range_.end();
+        for (std::size_t i = 1; i < size_ && last != end; ++i) {
+          ++last;
+        }
+        return iterator(std::move(first), std::move(last), size_);
+      }
+
+      constexpr iterator end() { return End(RandomAccess()); }
+
+     private:
+      constexpr iterator End(std::true_type /* random access */) {
+        Iterator begin = range_.begin();
+        Iterator end = range_.end();
+        std::ptrdiff_t back = std::min(
+            static_cast<std::ptrdiff_t>(size_) - 1, end - begin);
+        return iterator(end - back, end, size_);
+      }
+      // Only last_ is compared, and such iterators can't be walked backwards.
+      constexpr iterator End(std::false_type /* random access */) {
+        Iterator end = range_.end();
+        return iterator(end, end, size_);
+      }
+
+      Range range_;
+      std::size_t size_;
+    };
+
+    template <typename T, std::size_t>
+    using Repeat = T;
+
+    template <typename T, typename Indices>
+    struct RepeatedTuple;
+    template <typename T, std::size_t... kIndices>
+    struct RepeatedTuple<T, std::index_sequence<kIndices...>> {
+      using Type = std::tuple<Repeat<T, kIndices>...>;
+    };
+
+    // Tuples of references to each kSize consecutive elements of Range, each
+    // a step further than the previous one. Iterators hold a ring of kSize
+    // iterators to consecutive elements: each step moves the newest one to
+    // the next element, in place of the oldest one.
+    template <typename Range, std::size_t kSize>
+    struct AdjacentRange {
+      static_assert(kSize > 0, "Adjacent() needs at least one element");
+      using Indices = std::make_index_sequence<kSize>;
+      using RandomAccess = std::integral_constant<
+          bool, HasCategory<std::random_access_iterator_tag, Range>()>;
+      using Iterator = typename Range::iterator;
+
+      constexpr explicit AdjacentRange(Range range)
+        : range_(std::move(range)) {}
+
+      AdjacentRange(AdjacentRange&&) = default;
+      AdjacentRange& operator=(AdjacentRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = MultiPassCategory<Range>;
+        using value_type = typename RepeatedTuple<StorableValueType<Range>,
+                                                  Indices>::Type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference =
+            typename RepeatedTuple<ReferenceType<Range>, Indices>::Type;
+
+        // The ring starts at `first`, and stops at `end`.
+        constexpr iterator(const Iterator& first, const Iterator& end)
+          : ring_(Ring(first, end, Indices())),
+            head_(0) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          return Dereference(Indices());
+        }
+        constexpr reference operator[](difference_type n) const {
+          return *(*this + n);
+        }
+
+        constexpr iterator& operator++() {
+          Increment(RandomAccess());
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          return *this -= 1;
+        }
+
+        constexpr iterator& operator+=(difference_type n) {
+          for (Iterator& it : ring_) {
+            it += n;
+          }
+          return *this;
+        }
+
+        constexpr iterator& operator-=(difference_type n) {
+          for (Iterator& it : ring_) {
+            it -= n;
+          }
+          return *this;
+        }
+
+        constexpr iterator operator+(difference_type n) const {
+          iterator result = *this;
+          return result += n;
+        }
+
+        constexpr iterator operator-(difference_type n) const {
+          iterator result = *this;
+          return result -= n;
+        }
+
+        constexpr difference_type operator-(const iterator& o) const {
+          return newest() - o.newest();
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return newest() == o.newest();
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return newest() != o.newest();
+        }
+
+        constexpr bool operator<(const iterator& o) const {
+          return newest() < o.newest();
+        }
+
+       private:
+        // Random-access iterators are all moved instead, so that the ring
+        // stays in order and compilers may vectorize loops over it.
+        constexpr void Increment(std::true_type /* random access */) {
+          *this += 1;
+        }
+        constexpr void Increment(std::false_type /* random access */) {
+          Iterator next = newest();
+          ++next;
+          ring_[head_] = std::move(next);
+          head_ = (head_ + 1) % kSize;
+        }
+
+        template <std::size_t... kIndices>
+        constexpr reference Dereference(
+            std::index_sequence<kIndices...>) const {
+          return reference(*ring_[Position(kIndices, RandomAccess())]...);
+        }
+
+        constexpr std::size_t Position(
+            std::size_t index, std::true_type /* random access */) const {
+          return index;
+        }
+        constexpr std::size_t Position(
+            std::size_t index, std::false_type /* random access */) const {
+          return (head_ + index) % kSize;
+        }
+
+        template <std::size_t... kIndices>
+        static constexpr std::array<Iterator, kSize> Ring(
+            const Iterator& first, const Iterator& end,
+            std::index_sequence<kIndices...>) {
+          return {{Next(first, end, kIndices)...}};
+        }
+
+        static constexpr Iterator Next(Iterator it, const Iterator& end,
+                                       std::size_t count) {
+          for (; count != 0 && it != end; --count) {
+            ++it;
+          }
+          return it;
+        }
+
+        constexpr const Iterator& newest() const {
+          return ring_[Position(kSize - 1, RandomAccess())];
+        }
+
+        std::array<Iterator, kSize> ring_;
+        // Where the oldest iterator is. Always 0 for random-access ranges.
+        std::size_t head_;
+      };
+
+      // Ranges shorter than kSize have no tuples: their newest iterator is
+      // at the end already.
+      constexpr iterator begin() {
+        return iterator(range_.begin(), range_.end());
+      }
+
+      constexpr iterator end() { return End(RandomAccess()); }
+
+     private:
+      constexpr iterator End(std::true_type /* random access */) {
+        Iterator begin = range_.begin();
+        Iterator end = range_.end();
+        std::ptrdiff_t back = std::min(
+            static_cast<std::ptrdiff_t>(kSize) - 1, end - begin);
+        return iterator(end - back, end);
+      }
+      // Only the newest iterator is compared, and such iterators can't be
+      // walked backwards.
+      constexpr iterator End(std::false_type /* random access */) {
+        Iterator end = range_.end();
+        return iterator(end, end);
+      }
+
+      Range range_;
+    };
+
+    // How PrefetchRange hands elements over between threads: by address when
+    // they outlive the iteration step (see IsAddressable()), and by value
+    // otherwise.
+    template <typename Range, bool kByAddress = IsAddressable<Range>()>
+    struct PrefetchSlot {
+      using Type = ValueType<Range>*;
+      using Reference = ValueType<Range>&;
+
+      static Type Make(ReferenceType<Range> value) { return &value; }
+      static Reference Get(Type& slot) { return *slot; }
+    };
+
+    template <typename Range>
+    struct PrefetchSlot<Range, false> {
+      using Type = StorableValueType<Range>;
+      using Reference = Type&;
+
+      template <typename Value>
+      static Value&& Make(Value&& value) { return std::forward<Value>(value); }
+      static Reference Get(Type& slot) { return slot; }
+    };
+
+    // Iterates Range on a background thread, which runs ahead of the consumer
+    // by up to `capacity` elements. Elements are handed over through a
+    // lock-free single-producer/single-consumer ring buffer. A side which
+    // finds the ring empty (or full) spins briefly, and then blocks until
+    // the other side makes progress.
+    // The background thread is started by begin(), and is stopped when the
+    // range is destroyed, even if it was not fully consumed.
+    template <typename Range>
+    struct PrefetchRange {
+      using Slot = PrefetchSlot<Range>;
+
+      explicit PrefetchRange(Range range, std::size_t capacity)
+        : state_(new State(std::move(range), capacity)) {}
+
+      PrefetchRange(PrefetchRange&&) = default;
+
+      // The background thread of the range replaced must be stopped before
+      // its state is destroyed.
+      PrefetchRange& operator=(PrefetchRange&& o) {
+        if (state_ != nullptr && state_ != o.state_) {
+          state_->Stop();
+        }
+        state_ = std::move(o.state_);
+        return *this;
+      }
+
+      ~PrefetchRange() {
+        if (state_ != nullptr) {
+          state_->Stop();
+        }
+      }
+
+      struct State;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::input_iterator_tag;
+        using value_type = typename std::remove_reference<
+            typename Slot::Reference>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = typename Slot::Reference;
+
+        explicit iterator(State* state)
+          : state_(state) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        reference operator*() const {
+          RAMAN_ASSERT(!IsAtEnd());
+          return state_->Current();
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(!IsAtEnd());
+          state_->Pop();
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return IsAtEnd() == o.IsAtEnd();
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        // end() has no state.
+        bool IsAtEnd() const {
+          return state_ == nullptr || state_->IsAtEnd();
+        }
+
+        State* state_;
+      };
+
+      iterator begin() {
+        state_->Start();
+        return iterator(state_.get());
+      }
+
+      iterator end() {
+        return iterator(nullptr);
+      }
+
+      // Shared by the consumer and the background thread. Allocated on the
+      // heap, as it must not move while the background thread is running.
+      struct State {
+        explicit State(Range range_arg, std::size_t capacity)
+          : range(std::move(range_arg)),
+            ring(std::max<std::size_t>(capacity, 1)) {}
+
+        void Start() {
+          if (!thread.joinable()) {
+            thread = std::thread([this]() { Produce(); });
+            WaitForHead();
+          }
+        }
+
+        void Stop() {
+          if (thread.joinable()) {
+            cancelled.store(true, std::memory_order_relaxed);
+            Wake(producer_waiting);
+            thread.join();
+          }
+        }
+
+        typename Slot::Reference Current() {
+          return Slot::Get(ring[head % ring.size()].Value());
+        }
+
+        void Pop() {
+          ring[head % ring.size()].Reset();
+          head_published.store(++head, std::memory_order_release);
+          Wake(producer_waiting);
+          WaitForHead();
+        }
+
+        bool IsAtEnd() const { return is_at_end; }
+
+        // Runs on the background thread.
+        void Produce() {
+          std::size_t tail = 0;
+          try {
+            for (auto&& value : range) {
+              Await(producer_waiting, [this, tail]() {
+                return tail - head_published.load(std::memory_order_acquire) !=
+                           ring.size() ||
+                       cancelled.load(std::memory_order_relaxed);
+              });
+              if (cancelled.load(std::memory_order_relaxed)) {
+                break;
+              }
+              ring[tail % ring.size()].Emplace(
+                  Slot::Make(std::forward<decltype(value)>(value)));
+              tail_published.store(++tail, std::memory_order_release);
+              Wake(consumer_waiting);
+            }
+          } catch (...) {
+            exception = std::current_exception();
+          }
+          done.store(true, std::memory_order_release);
+          Wake(consumer_waiting);
+        }
+
+        // Waits until the element at `head` was produced, or until there are
+        // no more elements.
+        void WaitForHead() {
+          Await(consumer_waiting, [this]() {
+            return tail_published.load(std::memory_order_acquire) != head ||
+                   done.load(std::memory_order_acquire);
+          });
+          // Elements may have been published right before `done`.
+          if (tail_published.load(std::memory_order_acquire) == head) {
+            is_at_end = true;
+            if (exception != nullptr) {
+              std::rethrow_exception(exception);
+            }
+          }
+        }
+
+        // Returns once `ready()` holds. Spins for a while first, as the
+        // other side usually catches up quickly, and then blocks until
+        // Wake(waiting) is called.
+        template <typename Ready>
+        void Await(std::atomic<bool>& waiting, Ready ready) {
+          for (int i = 0; i < kSpins; ++i) {
+            if (ready()) {
+              return;
+            }
+            std::this_thread::yield();
+          }
+          std::unique_lock<std::mutex> lock(mutex);
+          waiting.store(true, std::memory_order_relaxed);
+          // Pairs with the fence in Wake(): either the other side sees
+          // `waiting`, or ready() sees what it published.
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          wakeup.wait(lock, ready);
+          waiting.store(false, std::memory_order_relaxed);
+        }
+
+        // Wakes the other side up, if it's blocked in Await(waiting), after
+        // it was published what it waits for.
+        void Wake(std::atomic<bool>& waiting) {
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if (waiting.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeup.notify_all();
+          }
+        }
+
+        static constexpr int kSpins = 64;
+
+        Range range;
+        std::vector<Optional<typename Slot::Type>> ring;
+        std::thread thread;
+        std::exception_ptr exception;
+        std::atomic<bool> done{false};
+        std::atomic<bool> cancelled{false};
+        // Only used once a side blocks.
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::atomic<bool> consumer_waiting{false};
+        std::atomic<bool> producer_waiting{false};
+
+        // Written by the consumer only. Kept on a separate cache line from
+        // the producer's index, as they are written concurrently (padding is
+        // used instead of alignas(), which `new` ignores prior to C++17).
+        char head_padding[64];
+        std::atomic<std::size_t> head_published{0};
+        std::size_t head = 0;
+        bool is_at_end = false;
+
+        // Written by the background thread only.
+        char tail_padding[64];
+        std::atomic<std::size_t> tail_published{0};
+      };
+
+     private:
+      std::unique_ptr<State> state_;
+    };
+
+    // Running results of Operation over the elements of Range, as Scan()
+    // and InclusiveScan() yield them. Scan() starts from an initial value
+    // and yields it before each element is added, like std::exclusive_scan
+    // does; InclusiveScan() yields the first element, and then each result
+    // after adding the next, like std::inclusive_scan does.
+    template <typename Range, typename T, typename Operation, bool kInclusive>
+    struct ScanRange : private AssignableFunctor<Operation> {
+      explicit ScanRange(Range range, Optional<T> init, Operation operation)
+        : AssignableFunctor<Operation>(std::move(operation)),
+          range_(std::move(range)),
+          init_(std::move(init)) {
+        RAMAN_ASSERT(init_.HasValue() != kInclusive);
+      }
+
+      ScanRange(ScanRange&&) = default;
+      ScanRange& operator=(ScanRange&&) = default;
+
+      struct iterator {
+        using Iterator = typename Range::iterator;
+
+        // iterator typedefs.
+        using iterator_category = WeakerCategory<std::forward_iterator_tag,
+                                                 IteratorCategory<Iterator>>;
+        using value_type = T;
+        using difference_type =
+            typename std::iterator_traits<Iterator>::difference_type;
+        using pointer = void;
+        // Results are held by the iterator, so they are returned by value
+        // like Iota() does, to keep them valid once it moves on.
+        using reference = T;
+
+        explicit iterator(ScanRange* range, Iterator iterator)
+          : range_(range),
+            iterator_(std::move(iterator)) {
+          Start(std::integral_constant<bool, kInclusive>());
+        }
+
+        // Optional<T> is move-only.
+        iterator(const iterator& o)
+          : range_(o.range_),
+            iterator_(o.iterator_) {
+          if (o.value_.HasValue()) {
+            value_.Emplace(o.value_.Value());
+          }
+        }
+
+        iterator& operator=(const iterator& o) {
+          range_ = o.range_;
+          iterator_ = o.iterator_;
+          value_.Reset();
+          if (o.value_.HasValue()) {
+            value_.Emplace(o.value_.Value());
+          }
+          return *this;
+        }
+
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        T operator*() const {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          return value_.Value();
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(iterator_ != range_->range_.end());
+          Step(std::integral_constant<bool, kInclusive>());
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && iterator_ == o.iterator_);
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        void Start(std::true_type /* inclusive */) {
+          if (iterator_ != range_->range_.end()) {
+            value_.Emplace(*iterator_);
+          }
+        }
+        void Start(std::false_type /* inclusive */) {
+          value_.Emplace(range_->init_.Value());
+        }
+
+        // The result for the next element, if any, once added.
+        void Step(std::true_type /* inclusive */) {
+          if (++iterator_ != range_->range_.end()) {
+            value_.Value() = range_->operation()(
+                std::move(value_.Value()), *iterator_);
+          }
+        }
+        // The result with the current element added.
+        void Step(std::false_type /* inclusive */) {
+          value_.Value() = range_->operation()(
+              std::move(value_.Value()), *iterator_);
+          ++iterator_;
+        }
+
+        ScanRange* range_;
+        Iterator iterator_;
+        Optional<T> value_;
+      };
+
+      iterator begin() { return iterator(this, range_.begin()); }
+
+      iterator end() { return iterator(this, range_.end()); }
+
+     private:
+      Operation& operation() { return AssignableFunctor<Operation>::Get(); }
+
+      Range range_;
+      Optional<T> init_;
+    };
+
+    // Calls function(i) for each i < count, each on a thread of its own
+    // (the calling thread taking i = 0), and rethrows the first exception
+    // any of them threw once all are done.
+    template <typename Function>
+    void RunOnThreads(std::size_t count, Function function) {
+      std::vector<std::exception_ptr> exceptions(count);
+      auto run = [&function, &exceptions](std::size_t i) {
+        try {
+          function(i);
+        } catch (...) {
+          exceptions[i] = std::current_exception();
+        }
+      };
+      std::vector<std::thread> threads;
+      threads.reserve(count - 1);
+      for (std::size_t i = 1; i < count; ++i) {
+        threads.emplace_back(run, i);
+      }
+      run(0);
+      for (std::thread& thread : threads) {
+        thread.join();
+      }
+      for (std::exception_ptr& exception : exceptions) {
+        if (exception != nullptr) {
+          std::rethrow_exception(exception);
+        }
+      }
+    }
+
+    // Blocks smaller than this are scanned by a single thread, as starting
+    // threads costs more than scanning them.
+    constexpr std::size_t kMinParallelScanBlock = 1 << 16;
+
+    // Writes the exclusive scan of the `size` elements from `begin` to
+    // `output`, in two passes over blocks of them, one per thread: the
+    // first reduces each block but the last, and once the results of the
+    // blocks before each are added up, the second scans every block from
+    // there.
+    template <typename Iterator, typename T, typename Operation>
+    void ParallelExclusiveScan(Iterator begin, std::size_t size, T init,
+                               const Operation& operation,
+                               std::size_t threads, T* output) {
+      std::size_t blocks = std::max<std::size_t>(
+          1, std::min(threads, size / kMinParallelScanBlock));
+      auto block_begin = [size, blocks](std::size_t block) {
+        return static_cast<std::ptrdiff_t>(size * block / blocks);
+      };
+      std::vector<Optional<T>> starts(blocks);
+      starts[0].Emplace(std::move(init));
+      if (blocks > 1) {
+        std::vector<Optional<T>> totals(blocks - 1);
+        RunOnThreads(blocks - 1, [&](std::size_t block) {
+          Operation op = operation;
+          Iterator it = begin + block_begin(block);
+          Iterator end = begin + block_begin(block + 1);
+          T total = *it;
+          for (++it; it != end; ++it) {
+            total = op(std::move(total), *it);
+          }
+          totals[block].Emplace(std::move(total));
+        });
+        for (std::size_t block = 1; block < blocks; ++block) {
+          starts[block].Emplace(operation(starts[block - 1].Value(),
+                                          totals[block - 1].Value()));
+        }
+      }
+      RunOnThreads(blocks, [&](std::size_t block) {
+        Operation op = operation;
+        T value = std::move(starts[block].Value());
+        T* out = output + block_begin(block);
+        Iterator end = begin + block_begin(block + 1);
+        for (Iterator it = begin + block_begin(block); it != end; ++it) {
+          T next = op(value, *it);
+          *out++ = std::move(value);
+          value = std::move(next);
+        }
+      });
+    }
+
+    // Number of elements in `range` if it can be computed in O(1), or 0.
+    template <typename Range>
+    constexpr std::size_t SizeHint(Range& range,
+                                   std::true_type /* random access */) {
+      return static_cast<std::size_t>(range.end() - range.begin());
+    }
+    template <typename Range>
+    constexpr std::size_t SizeHint(Range&,
+                                   std::false_type /* random access */) {
+      return 0;
+    }
+    template <typename Range>
+    constexpr std::size_t SizeHint(Range& range) {
+      return SizeHint(range, std::integral_constant<
+          bool, HasCategory<std::random_access_iterator_tag, Range>()>());
+    }
+
+    // A position in Range, as returned by Cursor(), from which elements are
+    // taken a page at a time. Range is held on the heap, along with the
+    // iterators into it, so the cursor may be moved or stored between
+    // pages without repeating the work they did (filtering, sorting, ...).
+    template <typename Range>
+    struct RangeCursor {
+      using Value = StorableValueType<Range>;
+
+      explicit RangeCursor(Range range)
+        : state_(new State(std::move(range))) {}
+
+      RangeCursor(RangeCursor&&) = default;
+      RangeCursor& operator=(RangeCursor&&) = default;
+
+      // Copies of the next `count` elements, or of all those left if fewer.
+      std::vector<Value> Next(std::size_t count) {
+        Start();
+        std::vector<Value> page;
+        page.reserve(std::min(count, SizeHint(state_->range)));
+        auto& it = state_->iterator.Value();
+        for (; page.size() < count && it != state_->end.Value(); ++it) {
+          page.push_back(*it);
+        }
+        state_->position += page.size();
+        return page;
+      }
+
+      // Whether all elements were taken.
+      bool IsDone() {
+        Start();
+        return state_->iterator.Value() == state_->end.Value();
+      }
+
+      // How many elements were taken so far.
+      std::size_t Position() const { return state_->position; }
+
+     private:
+      using Iterator = typename Range::iterator;
+
+      // Must not move once iterators point into it.
+      struct State {
+        explicit State(Range range_arg)
+          : range(std::move(range_arg)) {}
+
+        Range range;
+        Optional<Iterator> iterator;
+        Optional<Iterator> end;
+        std::size_t position = 0;
+      };
+
+      // The range is only iterated, and a Sort() buffered, once needed.
+      void Start() {
+        if (!state_->iterator.HasValue()) {
+          state_->iterator.Emplace(state_->range.begin());
+          state_->end.Emplace(state_->range.end());
+        }
+      }
+
+      std::unique_ptr<State> state_;
+    };
+
+    template <typename Container, typename = void>
+    struct HasReserve : std::false_type {};
+    template <typename Container>
+    struct HasReserve<Container, decltype(
+        void(std::declval<Container&>().reserve(std::size_t())))>
+        : std::true_type {};
+
+    // Reserves room for `size` elements, if `container` supports it.
+    template <typename Container>
+    constexpr void ReserveIfPossible(Container& container, std::size_t size) {
+      ReserveIfPossible(container, size, HasReserve<Container>());
+    }
+    template <typename Container>
+    constexpr void ReserveIfPossible(Container& container, std::size_t size,
+                                     std::true_type /* has reserve */) {
+      if (size != 0) {
+        container.reserve(size);
+      }
+    }
+    template <typename Container>
+    constexpr void ReserveIfPossible(Container&, std::size_t,
+                                     std::false_type /* has reserve */) {}
+
+    template <typename Container>
+    struct IsStdArray : std::false_type {};
+    template <typename T, std::size_t N>
+    struct IsStdArray<std::array<T, N>> : std::true_type {};
+
+    // Whether Iterator walks elements laid out one after the other in memory.
+    // C++20 iterators say so; before that, only pointers and the iterators of
+    // std::vector and std::array are known to.
+#ifdef __cpp_lib_concepts
+    template <typename Iterator>
+    struct IsContiguous : std::integral_constant<
+        bool, std::contiguous_iterator<Iterator>> {};
+#else
+    template <typename Iterator,
+              typename Value = typename std::remove_cv<typename std::
+                  iterator_traits<Iterator>::value_type>::type>
+    struct IsContiguous : std::integral_constant<
+        bool,
+        std::is_pointer<Iterator>::value ||
+        std::is_same<Iterator, typename std::array<Value, 1>::iterator>::value ||
+        std::is_same<Iterator,
+                     typename std::array<Value, 1>::const_iterator>::value ||
+        (!std::is_same<Value, bool>::value &&
+         (std::is_same<Iterator, typename std::vector<Value>::iterator>::value ||
+          std::is_same<Iterator,
+                       typename std::vector<Value>::const_iterator>::value))> {};
+#endif
+
+    // Elements tested at once by the vectorized search.
+    constexpr std::ptrdiff_t kSearchBlock = 16;
+
+    // Index of the first of `size` elements at `data` accepted by
+    // `predicate`, or `size`. Whole blocks are tested without branching,
+    // which compilers turn into SIMD comparisons, so `predicate` is also
+    // called on the elements following the one found in its block.
+    template <typename T, typename Predicate>
+    constexpr std::ptrdiff_t BlockFindIf(T* data, std::ptrdiff_t size,
+                                         Predicate& predicate) {
+      std::ptrdiff_t i = 0;
+      for (; i + kSearchBlock <= size; i += kSearchBlock) {
+        // An integer rather than a bool, so that GCC vectorizes the loop.
+        unsigned found = 0;
+        for (std::ptrdiff_t j = 0; j < kSearchBlock; ++j) {
+          found |= predicate(data[i + j]) ? 1u : 0u;
+        }
+        if (found) {
+          break;
+        }
+      }
+      while (i < size && !predicate(data[i])) {
+        ++i;
+      }
+      return i;
+    }
+
+    // The first element of `range` accepted by `predicate`, or its end.
+    template <typename Range, typename Predicate>
+    constexpr auto FindIf(Range& range, Predicate& predicate) {
+      return FindIf(
+          range, predicate,
+          typename std::conditional<
+              std::is_arithmetic<StorableValueType<Range>>::value,
+              IsContiguous<typename Range::iterator>,
+              std::false_type>::type());
+    }
+    template <typename Range, typename Predicate>
+    constexpr auto FindIf(Range& range, Predicate& predicate,
+                          std::true_type /* vectorizable */) {
+      auto begin = range.begin();
+      auto size = range.end() - begin;
+      if (size == 0) {
+        return begin;
+      }
+      return begin + BlockFindIf(&*begin, size, predicate);
+    }
+    template <typename Range, typename Predicate>
+    constexpr auto FindIf(Range& range, Predicate& predicate,
+                          std::false_type /* vectorizable */) {
+      auto it = range.begin();
+      auto end = range.end();
+      while (it != end && !predicate(*it)) {
+        ++it;
+      }
+      return it;
+    }
+
+    // Buffer reordering which keeps the original order.
+    struct OriginalOrder {};
+
+    // Orders elements the other way around, so that Sort().Reverse() may
+    // sort in descending order instead of reversing afterwards.
+    template <typename Comparator>
+    struct ReversedComparator : private AssignableFunctor<Comparator> {
+      constexpr explicit ReversedComparator(Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)) {}
+
+      template <typename A, typename B>
+      constexpr bool operator()(const A& a, const B& b) {
+        return comparator()(b, a);
+      }
+
+      constexpr Comparator& comparator() {
+        return AssignableFunctor<Comparator>::Get();
+      }
+    };
+
+    template <typename Comparator>
+    constexpr ReversedComparator<Comparator> Reversed(Comparator comparator) {
+      return ReversedComparator<Comparator>(std::move(comparator));
+    }
+    template <typename Comparator>
+    constexpr Comparator Reversed(ReversedComparator<Comparator> reversed) {
+      return std::move(reversed.comparator());
+    }
+
+    // Elements are buffered either by address or by value.
+    template <typename Pointer>
+    constexpr auto& BufferedElement(Pointer& pointer,
+                                    std::true_type /* by address */) {
+      return *pointer;
+    }
+    template <typename Value>
+    constexpr Value& BufferedElement(Value& value,
+                                     std::false_type /* by address */) {
+      return value;
+    }
+
+    template <bool kByAddress, typename Element, typename Comparator>
+    constexpr void OrderBuffer(std::vector<Element>& buffer,
+                               Comparator& comparator) {
+      using ByAddress = std::integral_constant<bool, kByAddress>;
+      std::sort(buffer.begin(), buffer.end(),
+                [&](const Element& a, const Element& b) {
+        return comparator(BufferedElement(a, ByAddress()),
+                          BufferedElement(b, ByAddress()));
+      });
+    }
+    template <bool kByAddress, typename Element>
+    constexpr void OrderBuffer(std::vector<Element>&, OriginalOrder&) {}
+    template <bool kByAddress, typename Element>
+    constexpr void OrderBuffer(std::vector<Element>& buffer,
+                               ReversedComparator<OriginalOrder>&) {
+      std::reverse(buffer.begin(), buffer.end());
+    }
+
+    // Elements of Range ordered by Comparator. They are buffered and ordered
+    // on the first call to begin(), so stages following Sort() may still
+    // change how (see Reverse()). Elements which outlive the iteration step
+    // (see IsAddressable()) are buffered by address, so they may be modified;
+    // others are buffered by value.
+    template <typename Range, typename Comparator,
+              bool kByAddress = IsAddressable<Range>()>
+    struct SortedRange : private AssignableFunctor<Comparator> {
+      using Element = typename std::conditional<
+          kByAddress, ValueType<Range>*, StorableValueType<Range>>::type;
+      using Buffer = std::vector<Element>;
+      using ByAddress = std::integral_constant<bool, kByAddress>;
+
+      constexpr explicit SortedRange(Range range, Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)),
+          range_(std::move(range)) {}
+
+      SortedRange(SortedRange&&) = default;
+      SortedRange& operator=(SortedRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::random_access_iterator_tag;
+        using reference = decltype(
+            BufferedElement(std::declval<Element&>(), ByAddress()));
+        using value_type = typename std::decay<reference>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::add_pointer<reference>::type;
+
+        constexpr explicit iterator(typename Buffer::iterator iterator)
+          : iterator_(iterator) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        constexpr reference operator*() const {
+          return BufferedElement(*iterator_, ByAddress());
+        }
+        constexpr reference operator[](difference_type n) const {
+          return BufferedElement(iterator_[n], ByAddress());
+        }
+
+        constexpr iterator& operator++() {
+          ++iterator_;
+          return *this;
+        }
+
+        constexpr iterator& operator--() {
+          --iterator_;
+          return *this;
+        }
+
+        constexpr iterator& operator+=(difference_type n) {
+          iterator_ += n;
+          return *this;
+        }
+
+        constexpr iterator& operator-=(difference_type n) {
+          iterator_ -= n;
+          return *this;
+        }
+
+        constexpr iterator operator+(difference_type n) const {
+          return iterator(iterator_ + n);
+        }
+
+        constexpr iterator operator-(difference_type n) const {
+          return iterator(iterator_ - n);
+        }
+
+        constexpr difference_type operator-(const iterator& o) const {
+          return iterator_ - o.iterator_;
+        }
+
+        constexpr bool operator==(const iterator& o) const {
+          return iterator_ == o.iterator_;
+        }
+
+        constexpr bool operator!=(const iterator& o) const {
+          return iterator_ != o.iterator_;
+        }
+
+        constexpr bool operator<(const iterator& o) const {
+          return iterator_ < o.iterator_;
+        }
+
+       private:
+        typename Buffer::iterator iterator_;
+      };
+
+      constexpr iterator begin() {
+        OrderIfNeeded();
+        return iterator(buffer_.begin());
+      }
+
+      constexpr iterator end() {
+        OrderIfNeeded();
+        return iterator(buffer_.end());
+      }
+
+      // Fuses a following Reverse() by ordering the other way around.
+      constexpr auto Reverse() && {
+        using ReversedRange = SortedRange<
+            Range, decltype(Reversed(std::move(comparator()))), kByAddress>;
+        return ReversedRange(std::move(range_),
+                             Reversed(std::move(comparator())));
+      }
+
+     private:
+      constexpr void OrderIfNeeded() {
+        if (is_ordered_) {
+          return;
+        }
+        is_ordered_ = true;
+        ReserveIfPossible(buffer_, SizeHint(range_));
+        for (auto&& value : range_) {
+          Append(std::forward<decltype(value)>(value), ByAddress());
+        }
+        OrderBuffer<kByAddress>(buffer_, comparator());
+      }
+
+      template <typename Value>
+      constexpr void Append(Value& value, std::true_type /* by address */) {
+        buffer_.push_back(&value);
+      }
+      template <typename Value>
+      constexpr void Append(Value&& value, std::false_type /* by address */) {
+        buffer_.push_back(std::forward<Value>(value));
+      }
+
+      constexpr Comparator& comparator() {
+        return AssignableFunctor<Comparator>::Get();
+      }
+
+      Range range_;
+      Buffer buffer_;
+      bool is_ordered_ = false;
+    };
+
+    // Accumulators, as used by Aggregate(), take elements with Add() and
+    // return what they computed with Result(). Those holding elements are
+    // created with a void T, which Bind() replaces with the element type.
+    // Merge() adds what another accumulator took, for SlidingWindow().
+    struct CountAccumulator {
+      template <typename Value>
+      constexpr void Add(const Value&) {
+        ++count_;
+      }
+
+      constexpr void Merge(const CountAccumulator& o) {
+        count_ += o.count_;
+      }
+
+      constexpr std::size_t Result() const { return count_; }
+
+     private:
+      std::size_t count_ = 0;
+    };
+
+    template <typename T>
+    struct SumAccumulator {
+      template <typename Value>
+      constexpr void Add(const Value& value) {
+        sum_ += value;
+      }
+
+      constexpr void Merge(const SumAccumulator& o) {
+        sum_ += o.sum_;
+      }
+
+      constexpr T Result() const { return sum_; }
+
+     private:
+      T sum_{};
+    };
+    template <>
+    struct SumAccumulator<void> {
+      template <typename Value>
+      constexpr SumAccumulator<Value> Bind() const {
+        return SumAccumulator<Value>();
+      }
+    };
+
+    // The first of the smallest elements by Comparator, or T() if there were
+    // none.
+    template <typename T, typename Comparator>
+    struct MinAccumulator : private AssignableFunctor<Comparator> {
+      constexpr explicit MinAccumulator(Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)) {}
+
+      template <typename Value>
+      constexpr void Add(const Value& value) {
+        if (!has_value_ || comparator()(value, min_)) {
+          min_ = value;
+          has_value_ = true;
+        }
+      }
+
+      // `o` took later elements, which are kept only if smaller.
+      constexpr void Merge(const MinAccumulator& o) {
+        if (o.has_value_) {
+          Add(o.min_);
+        }
+      }
+
+      constexpr T Result() const { return min_; }
+
+     private:
+      constexpr Comparator& comparator() {
+        return AssignableFunctor<Comparator>::Get();
+      }
+
+      T min_{};
+      bool has_value_ = false;
+    };
+    template <typename Comparator>
+    struct MinAccumulator<void, Comparator>
+        : private AssignableFunctor<Comparator> {
+      constexpr explicit MinAccumulator(Comparator comparator)
+        : AssignableFunctor<Comparator>(std::move(comparator)) {}
+
+      template <typename Value>
+      constexpr MinAccumulator<Value, Comparator> Bind() {
+        return MinAccumulator<Value, Comparator>(
+            std::move(AssignableFunctor<Comparator>::Get()));
+      }
+    };
+
+    // Counts of elements by the bucket index in [0, count) Key returns.
+    template <typename Key>
+    struct HistogramAccumulator : private AssignableFunctor<Key> {
+      explicit HistogramAccumulator(std::size_t count, Key key)
+        : AssignableFunctor<Key>(std::move(key)),
+          counts_(count) {}
+
+      template <typename Value>
+      void Add(const Value& value) {
+        std::size_t index =
+            static_cast<std::size_t>(AssignableFunctor<Key>::Get()(value));
+        RAMAN_ASSERT(index < counts_.size());
+        ++counts_[index];
+      }
+
+      void Merge(const HistogramAccumulator& o) {
+        RAMAN_ASSERT(counts_.size() == o.counts_.size());
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+          counts_[i] += o.counts_[i];
+        }
+      }
+
+      std::vector<std::size_t> Result() && { return std::move(counts_); }
+
+     private:
+      std::vector<std::size_t> counts_;
+    };
+
+    // Keeps a uniform random sample of up to `k` of the elements it's given,
+    // in O(k) memory, with Li's Algorithm L: once the reservoir is full, it
+    // draws how many elements to skip before the next one it keeps, so
+    // that Rng is called O(k log(n / k)) times for n elements rather than
+    // n times. Skip() lets random-access ranges jump over those.
+    template <typename Value, typename Rng>
+    struct ReservoirSampler {
+      explicit ReservoirSampler(std::size_t k, Rng& rng)
+        : k_(k),
+          rng_(&rng) {
+        sample_.reserve(k);
+      }
+
+      void Add(const Value& value) {
+        if (sample_.size() < k_) {
+          sample_.push_back(value);
+          if (sample_.size() == k_) {
+            weight_ = std::exp(std::log(Uniform()) / static_cast<double>(k_));
+            DrawSkip();
+          }
+        } else if (skip_ > 0) {
+          --skip_;
+        } else if (k_ > 0) {
+          sample_[std::uniform_int_distribution<std::size_t>(0, k_ - 1)(
+              *rng_)] = value;
+          weight_ *= std::exp(std::log(Uniform()) / static_cast<double>(k_));
+          DrawSkip();
+        }
+      }
+
+      // How many of the next elements Add() would ignore.
+      std::size_t ToSkip() const {
+        return sample_.size() < k_ ? 0
+                                   : k_ == 0 ? std::numeric_limits<
+                                                   std::size_t>::max()
+                                             : skip_;
+      }
+
+      // Counts `count` <= ToSkip() elements as passed to Add().
+      void Skip(std::size_t count) {
+        RAMAN_ASSERT(count <= ToSkip());
+        skip_ -= std::min(count, skip_);
+      }
+
+      // In no particular order.
+      std::vector<Value> Result() && { return std::move(sample_); }
+
+     private:
+      // Uniform in (0, 1), as 0 has no logarithm.
+      double Uniform() {
+        return std::uniform_real_distribution<double>(
+            std::numeric_limits<double>::min(), 1)(*rng_);
+      }
+
+      void DrawSkip() {
+        double skip = std::floor(std::log(Uniform()) / std::log1p(-weight_));
+        skip_ = skip < static_cast<double>(
+                           std::numeric_limits<std::size_t>::max())
+                    ? static_cast<std::size_t>(skip)
+                    : std::numeric_limits<std::size_t>::max();
+      }
+
+      std::size_t k_;
+      Rng* rng_;
+      std::vector<Value> sample_;
+      double weight_ = 0;
+      std::size_t skip_ = 0;
+    };
+
+    // Adds elements of `range` to `sampler`, jumping over those it skips
+    // when the range is random-access.
+    template <typename Range, typename Sampler>
+    void SampleFrom(Range& range, Sampler& sampler,
+                    std::true_type /* random access */) {
+      auto it = range.begin();
+      std::size_t remaining = static_cast<std::size_t>(range.end() - it);
+      while (remaining > 0) {
+        std::size_t skip = sampler.ToSkip();
+        if (skip >= remaining) {
+          return;
+        }
+        it += static_cast<std::ptrdiff_t>(skip);
+        sampler.Skip(skip);
+        sampler.Add(*it);
+        ++it;
+        remaining -= skip + 1;
+      }
+    }
+    template <typename Range, typename Sampler>
+    void SampleFrom(Range& range, Sampler& sampler,
+                    std::false_type /* random access */) {
+      for (auto&& value : range) {
+        sampler.Add(value);
+      }
+    }
+
+    // Accumulates what Projection returns for elements.
+    template <typename Projection, typename Accumulator>
+    struct ProjectedAccumulator : private AssignableFunctor<Projection> {
+      constexpr ProjectedAccumulator(Projection projection,
+                                     Accumulator accumulator)
+        : AssignableFunctor<Projection>(std::move(projection)),
+          accumulator_(std::move(accumulator)) {}
+
+      template <typename Value>
+      constexpr void Add(const Value& value) {
+        accumulator_.Add(AssignableFunctor<Projection>::Get()(value));
+      }
+
+      constexpr void Merge(const ProjectedAccumulator& o) {
+        accumulator_.Merge(o.accumulator_);
+      }
+
+      constexpr auto Result() && { return std::move(accumulator_).Result(); }
+
+      template <typename Value>
+      constexpr auto Bind();
+
+     private:
+      Accumulator accumulator_;
+    };
+
+    template <typename Accumulator, typename Value, typename = void>
+    struct IsUnbound : std::false_type {};
+    template <typename Accumulator, typename Value>
+    struct IsUnbound<Accumulator, Value, decltype(void(
+        std::declval<Accumulator&>().template Bind<Value>()))>
+        : std::true_type {};
+
+    template <typename Value, typename Accumulator>
+    constexpr auto BindAccumulator(Accumulator accumulator,
+                                   std::true_type /* unbound */) {
+      return accumulator.template Bind<Value>();
+    }
+    template <typename Value, typename Accumulator>
+    constexpr Accumulator BindAccumulator(Accumulator accumulator,
+                                          std::false_type /* unbound */) {
+      return accumulator;
+    }
+    template <typename Value, typename Accumulator>
+    constexpr auto BindAccumulator(Accumulator accumulator) {
+      return BindAccumulator<Value>(std::move(accumulator),
+                                    IsUnbound<Accumulator, Value>());
+    }
+
+    template <typename Projection, typename Accumulator>
+    template <typename Value>
+    constexpr auto ProjectedAccumulator<Projection, Accumulator>::Bind() {
+      using Projected = typename std::decay<decltype(std::declval<
+          Projection&>()(std::declval<const Value&>()))>::type;
+      auto bound = BindAccumulator<Projected>(std::move(accumulator_));
+      return ProjectedAccumulator<Projection, decltype(bound)>(
+          std::move(AssignableFunctor<Projection>::Get()), std::move(bound));
+    }
+
+    template <typename Accumulators, typename Value, std::size_t... kIndices>
+    constexpr void AddToAll(Accumulators& accumulators, const Value& value,
+                            std::index_sequence<kIndices...>) {
+      int unused[] = {
+          0, (std::get<kIndices>(accumulators).Add(value), 0)...};
+      (void)unused;
+    }
+
+    template <typename Accumulators, std::size_t... kIndices>
+    constexpr auto Results(Accumulators accumulators,
+                           std::index_sequence<kIndices...>) {
+      return std::make_tuple(
+          std::get<kIndices>(std::move(accumulators)).Result()...);
+    }
+
+    template <typename Accumulators, std::size_t... kIndices>
+    constexpr void MergeAll(Accumulators& accumulators,
+                            const Accumulators& others,
+                            std::index_sequence<kIndices...>) {
+      int unused[] = {
+          0, (std::get<kIndices>(accumulators).Merge(
+                  std::get<kIndices>(others)), 0)...};
+      (void)unused;
+    }
+
+    // Division and remainder rounding towards negative infinity, so that
+    // keys before 0 fall in windows like the others.
+    template <typename T>
+    constexpr T FloorDivide(T dividend, T divisor) {
+      T quotient = dividend / divisor;
+      return (dividend % divisor != 0 && (dividend < 0) != (divisor < 0))
+                 ? quotient - 1
+                 : quotient;
+    }
+    template <typename T>
+    constexpr T FloorModulo(T dividend, T divisor) {
+      return dividend - FloorDivide(dividend, divisor) * divisor;
+    }
+
+    // Aggregates of the elements of Range over windows of `width` keys,
+    // starting every `step` keys, by the integer keys Key returns, which
+    // must not decrease. Windows are made of width / step panes of `step`
+    // keys, which Accumulators aggregate as elements stream by. A window is
+    // complete once an element past it arrives (or the range ends), and its
+    // result then merges its panes (kSliding), or is its single pane. Only
+    // the panes of a window are held, and windows without elements are
+    // skipped. Like GeneratedRange, it can only be iterated once.
+    template <typename Range, typename Key, bool kSliding,
+              typename... Accumulators>
+    struct WindowAggregateRange : private AssignableFunctor<Key> {
+      using KeyType =
+          typename std::decay<TransformedType<Range, Key>>::type;
+      static_assert(std::is_integral<KeyType>::value,
+                    "Window keys must be integers");
+      using Indices = std::index_sequence_for<Accumulators...>;
+      using Bound = std::tuple<decltype(BindAccumulator<
+          StorableValueType<Range>>(std::declval<Accumulators>()))...>;
+      using Value = std::pair<KeyType, decltype(
+          Results(std::declval<Bound>(), Indices()))>;
+
+      struct Pane {
+        KeyType index;
+        Bound accumulators;
+      };
+
+      explicit WindowAggregateRange(Range range, Key key, KeyType width,
+                                    KeyType step,
+                                    Accumulators... accumulators)
+        : AssignableFunctor<Key>(std::move(key)),
+          range_(std::move(range)),
+          step_(step),
+          panes_per_window_(width / step),
+          empty_(BindAccumulator<StorableValueType<Range>>(
+              std::move(accumulators))...),
+          panes_(static_cast<std::size_t>(panes_per_window_)) {
+        RAMAN_ASSERT(step > 0 && width > 0 && width % step == 0);
+      }
+
+      WindowAggregateRange(WindowAggregateRange&&) = default;
+      WindowAggregateRange& operator=(WindowAggregateRange&&) = default;
+
+      struct iterator {
+        // iterator typedefs.
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Value*;
+        using reference = const Value&;
+
+        explicit iterator(WindowAggregateRange* range, bool is_end)
+          : range_(range),
+            is_end_(is_end) {}
+
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator&) = default;
+        iterator(iterator&&) = default;
+        iterator& operator=(iterator&&) = default;
+
+        const Value& operator*() const {
+          RAMAN_ASSERT(!IsEnd());
+          return range_->current_.Value();
+        }
+
+        iterator& operator++() {
+          RAMAN_ASSERT(!IsEnd());
+          range_->Advance();
+          return *this;
+        }
+
+        bool operator==(const iterator& o) const {
+          return (range_ == o.range_ && IsEnd() == o.IsEnd());
+        }
+
+        bool operator!=(const iterator& o) const {
+          return !(*this == o);
+        }
+
+       private:
+        bool IsEnd() const { return is_end_ || range_->is_done_; }
+
+        WindowAggregateRange* range_;
+        bool is_end_;
+      };
+
+      iterator begin() {
+        input_.Emplace(range_.begin());
+        Advance();
+        return iterator(this, false);
+      }
+
+      iterator end() { return iterator(this, true); }
+
+     private:
+      // Moves to the next window with elements. Windows are numbered by
+      // their last pane.
+      void Advance() {
+        while (true) {
+          bool is_input_done = !Peek();
+          if (has_elements_) {
+            // Later windows don't include any pane with elements so far.
+            KeyType bound = last_pane_ + panes_per_window_;
+            if (!is_input_done) {
+              bound = std::min(bound, next_pane_);
+            }
+            while (next_window_ < bound) {
+              if (Emit(next_window_++)) {
+                return;
+              }
+            }
+          }
+          if (is_input_done) {
+            is_done_ = true;
+            return;
+          }
+          Consume();
+        }
+      }
+
+      // Whether there's another element, computing its pane if so.
+      bool Peek() {
+        if (is_peeked_) {
+          return true;
+        }
+        if (input_.Value() == range_.end()) {
+          return false;
+        }
+        next_pane_ = FloorDivide(key()(*input_.Value()), step_);
+        is_peeked_ = true;
+        return true;
+      }
+
+      void Consume() {
+        if (!has_elements_ || next_pane_ != last_pane_) {
+          RAMAN_ASSERT(!has_elements_ || next_pane_ > last_pane_);
+          // The pane it replaces is only part of windows emitted already.
+          panes_[Slot(next_pane_)].Emplace(Pane{next_pane_, empty_});
+          next_window_ = has_elements_ ? std::max(next_window_, next_pane_)
+                                       : next_pane_;
+          last_pane_ = next_pane_;
+          has_elements_ = true;
+        }
+        // Adds the whole run of elements in this pane.
+        Bound& accumulators = panes_[Slot(last_pane_)].Value().accumulators;
+        do {
+          AddToAll(accumulators, *input_.Value(), Indices());
+          ++input_.Value();
+          is_peeked_ = false;
+        } while (Peek() && next_pane_ == last_pane_);
+      }
+
+      // Sets current_ to the result of `window`, if it has any elements.
+      bool Emit(KeyType window) {
+        KeyType pane = window - panes_per_window_ + 1;
+        while (pane <= window && !IsLive(pane)) {
+          ++pane;
+        }
+        if (pane > window) {
+          return false;
+        }
+        Bound merged(panes_[Slot(pane)].Value().accumulators);
+        for (++pane; pane <= window; ++pane) {
+          if (IsLive(pane)) {
+            Merge(merged, panes_[Slot(pane)].Value().accumulators,
+                  std::integral_constant<bool, kSliding>());
+          }
+        }
+        current_.Emplace((window - panes_per_window_ + 1) * step_,
+                         Results(std::move(merged), Indices()));
+        return true;
+      }
+
+      // Whether the slot of `pane` holds that pane, not an older one.
+      bool IsLive(KeyType pane) const {
+        const Optional<Pane>& slot = panes_[Slot(pane)];
+        return slot.HasValue() && slot.Value().index == pane;
+      }
+
+      void Merge(Bound& accumulators, const Bound& others,
+                 std::true_type /* sliding */) {
+        MergeAll(accumulators, others, Indices());
+      }
+      // Tumbling windows have a single pane, so accumulators need no Merge().
+      void Merge(Bound&, const Bound&, std::false_type /* sliding */) {
+        RAMAN_ASSERT(false);
+      }
+
+      std::size_t Slot(KeyType pane) const {
+        return static_cast<std::size_t>(FloorModulo(pane, panes_per_window_));
+      }
+
+      Key& key() { return AssignableFunctor<Key>::Get(); }
+
+      Range range_;
+      KeyType step_;
+      KeyType panes_per_window_;
+      // Copied to start each pane.
+      Bound empty_;
+      // Pane i is held in panes_[i % panes_per_window_].
+      std::vector<Optional<Pane>> panes_;
+      Optional<typename Range::iterator> input_;
+      // The pane of the element input_ points at, once peeked.
+      KeyType next_pane_{};
+      bool is_peeked_ = false;
+      // The latest pane with elements, if any.
+      KeyType last_pane_{};
+      bool has_elements_ = false;
+      // The first window not emitted yet.
+      KeyType next_window_{};
+      Optional<Value> current_;
+      bool is_done_ = false;
+    };
+
+    // Collects output for WriteTo() in a large buffer, and passes it on to a
+    // Sink in blocks of that size: either a stream (any type with
+    // write(data, size), like std::ostream), or a callable taking
+    // (data, size).
+    template <typename Sink, typename = void>
+    struct IsStreamSink : std::false_type {};
+    template <typename Sink>
+    struct IsStreamSink<Sink, decltype(void(std::declval<Sink&>().write(
+        std::declval<const char*>(), std::ptrdiff_t())))>
+        : std::true_type {};
+
+    template <typename Sink>
+    struct BufferedWriter {
+      static constexpr std::size_t kCapacity = 1 << 16;
+
+      explicit BufferedWriter(Sink& sink)
+        : sink_(sink),
+          buffer_(new char[kCapacity]) {}
+
+      BufferedWriter(const BufferedWriter&) = delete;
+      BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+      void Write(const char* data, std::size_t size) {
+        if (size > kCapacity - size_) {
+          Flush();
+          // Too large to buffer; written directly.
+          if (size > kCapacity) {
+            WriteToSink(data, size, IsStreamSink<Sink>());
+            return;
+          }
+        }
+        std::memcpy(buffer_.get() + size_, data, size);
+        size_ += size;
+      }
+
+      // Room for `size` chars, which Commit() adds once formatted there.
+      char* Reserve(std::size_t size) {
+        RAMAN_ASSERT(size <= kCapacity);
+        if (size > kCapacity - size_) {
+          Flush();
+        }
+        return buffer_.get() + size_;
+      }
+
+      void Commit(const char* end) {
+        size_ = static_cast<std::size_t>(end - buffer_.get());
+        RAMAN_ASSERT(size_ <= kCapacity);
+      }
+
+      void Flush() {
+        if (size_ > 0) {
+          WriteToSink(buffer_.get(), size_, IsStreamSink<Sink>());
+          size_ = 0;
+        }
+      }
+
+     private:
+      void WriteToSink(const char* data, std::size_t size,
+                       std::true_type /* stream */) {
+        sink_.write(data, static_cast<std::ptrdiff_t>(size));
+      }
+      void WriteToSink(const char* data, std::size_t size,
+                       std::false_type /* stream */) {
+        sink_(data, size);
+      }
+
+      Sink& sink_;
+      std::unique_ptr<char[]> buffer_;
+      std::size_t size_ = 0;
+    };
+
+    // How WriteTo() formats each type of element.
+    struct FormatAsText {};
+    struct FormatAsCString {};
+    struct FormatAsChar {};
+    struct FormatAsBool {};
+    struct FormatAsInteger {};
+    struct FormatAsFloat {};
+    struct Unformattable {};
+
+    template <typename T, typename = void>
+    struct FormatTag {
+      using Type = typename std::conditional<
+          std::is_same<T, bool>::value, FormatAsBool,
+          typename std::conditional<
+              std::is_same<T, char>::value, FormatAsChar,
+              typename std::conditional<
+                  std::is_integral<T>::value, FormatAsInteger,
+                  typename std::conditional<
+                      std::is_floating_point<T>::value, FormatAsFloat,
+                      typename std::conditional<
+                          std::is_convertible<T, const char*>::value,
+                          FormatAsCString,
+                          Unformattable>::type>::type>::type>::type>::type;
+    };
+    // Strings and string views, or any other chars with data() and size().
+    template <typename T>
+    struct FormatTag<T, typename std::enable_if<std::is_same<
+        typename std::decay<decltype(*std::declval<const T&>().data())>::type,
+        char>::value && std::is_integral<decltype(
+            std::declval<const T&>().size())>::value>::type> {
+      using Type = FormatAsText;
+    };
+
+    template <typename Writer, typename T>
+    void Format(Writer& writer, const T& text, FormatAsText) {
+      writer.Write(text.data(), static_cast<std::size_t>(text.size()));
+    }
+    template <typename Writer>
+    void Format(Writer& writer, const char* text, FormatAsCString) {
+      writer.Write(text, std::strlen(text));
+    }
+    template <typename Writer>
+    void Format(Writer& writer, char c, FormatAsChar) {
+      writer.Write(&c, 1);
+    }
+    // As std::ostream does by default.
+    template <typename Writer>
+    void Format(Writer& writer, bool b, FormatAsBool) {
+      writer.Write(b ? "1" : "0", 1);
+    }
+#ifndef RAMAN_HAS_CHARCONV
+    template <typename T>
+    constexpr bool IsNegative(T value, std::true_type /* signed */) {
+      return value < 0;
+    }
+    template <typename T>
+    constexpr bool IsNegative(T, std::false_type /* signed */) {
+      return false;
+    }
+#endif
+    template <typename Writer, typename T>
+    void Format(Writer& writer, T value, FormatAsInteger) {
+      // Digits, and a sign.
+      constexpr std::size_t kMaxSize = std::numeric_limits<T>::digits10 + 2;
+#ifdef RAMAN_HAS_CHARCONV
+      char* begin = writer.Reserve(kMaxSize);
+      writer.Commit(std::to_chars(begin, begin + kMaxSize, value).ptr);
+#else
+      using Unsigned = typename std::make_unsigned<T>::type;
+      bool is_negative = IsNegative(value, std::is_signed<T>());
+      Unsigned magnitude = is_negative
+                               ? Unsigned(0) - static_cast<Unsigned>(value)
+                               : static_cast<Unsigned>(value);
+      char digits[kMaxSize];
+      char* begin = digits + kMaxSize;
+      do {
+        *--begin = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+      } while (magnitude != 0);
+      if (is_negative) {
+        *--begin = '-';
+      }
+      writer.Write(begin, static_cast<std::size_t>(digits + kMaxSize - begin));
+#endif
+    }
+    // The shortest form which parses back to `value` where std::to_chars
+    // supports floating point, or enough digits to do so otherwise.
+    template <typename Writer, typename T>
+    void Format(Writer& writer, T value, FormatAsFloat) {
+      // Digits, sign, point, and exponent.
+      constexpr std::size_t kMaxSize =
+          std::numeric_limits<T>::max_digits10 + 10;
+      char* begin = writer.Reserve(kMaxSize);
+#if defined(RAMAN_HAS_CHARCONV) && defined(__cpp_lib_to_chars)
+      writer.Commit(std::to_chars(begin, begin + kMaxSize, value).ptr);
+#else
+      int size = std::is_same<T, long double>::value
+          ? std::snprintf(begin, kMaxSize, "%.*Lg",
+                          std::numeric_limits<T>::max_digits10,
+                          static_cast<long double>(value))
+          : std::snprintf(begin, kMaxSize, "%.*g",
+                          std::numeric_limits<T>::max_digits10,
+                          static_cast<double>(value));
+      writer.Commit(begin + size);
+#endif
+    }
+    template <typename Writer, typename T>
+    void Format(Writer&, const T&, Unformattable) {
+      static_assert(!std::is_same<T, T>::value,
+                    "WriteTo() writes numbers, chars and strings only; "
+                    "Transform() other elements to one of those first");
+    }
+
+    template <typename Writer, typename T>
+    void Format(Writer& writer, const T& value) {
+      Format(writer, value, typename FormatTag<T>::Type());
+    }
+
+    // Stage factories used by RamanWrapper. Their overloads fuse consecutive
+    // stages into cheaper equivalent ones, at compile time: Where().Where()
+    // checks both filters in a single stage, Transform().Transform() composes
+    // the transformers, Sort().Reverse() sorts in descending order, and
+    // AddressOf().Dereference() or Reverse().Reverse() are dropped.
+    template <typename Range, typename Filter>
+    constexpr auto MakeWhere(Range range, Filter filter) {
+      return FilteredRange<Range, Filter>(std::move(range), std::move(filter));
+    }
+    template <typename Range, typename Filter, typename OtherFilter>
+    constexpr auto MakeWhere(FilteredRange<Range, Filter> range,
+                             OtherFilter other) {
+      return std::move(range).Where(std::move(other));
+    }
+
+    template <typename Range, typename Transformer>
+    constexpr auto MakeTransform(Range range, Transformer transformer) {
+      return ByValueTransformerRange<Range, Transformer>(
+          std::move(range), std::move(transformer));
+    }
+    template <typename Range, typename Transformer, typename OtherTransformer>
+    constexpr auto MakeTransform(ByValueTransformerRange<Range, Transformer> range,
+                                 OtherTransformer other) {
+      return std::move(range).Transform(std::move(other));
+    }
+    template <typename Range, typename Transformer, typename OtherTransformer>
+    constexpr auto MakeTransform(ByRefTransformerRange<Range, Transformer> range,
+                                 OtherTransformer other) {
+      return std::move(range).Transform(std::move(other));
+    }
+    template <typename Range, typename OtherTransformer>
+    constexpr auto MakeTransform(DereferenceRange<Range> range,
+                                 OtherTransformer other) {
+      return std::move(range).Transform(std::move(other));
+    }
+
+    template <typename Range>
+    constexpr auto MakeDereference(Range range) {
+      return DereferenceRange<Range>(std::move(range));
+    }
+    template <typename Range, typename T>
+    constexpr Range MakeDereference(
+        ByValueTransformerRange<Range, AddressOfFunctor<T>> range) {
+      return std::move(range).Release();
+    }
+
+    template <typename Range>
+    constexpr auto MakeAddressOf(Range range) {
+      return ByValueTransformerRange<Range, AddressOfFunctor<ValueType<Range>>>(
+          std::move(range), AddressOfFunctor<ValueType<Range>>());
+    }
+    // Only raw pointers are their own address after Dereference().
+    template <typename Range>
+    constexpr auto MakeAddressOf(DereferenceRange<Range> range) {
+      return MakeAddressOf(std::move(range), std::integral_constant<
+          bool, std::is_pointer<StorableValueType<Range>>::value>());
+    }
+    template <typename Range>
+    constexpr Range MakeAddressOf(DereferenceRange<Range> range,
+                                  std::true_type /* raw pointers */) {
+      return std::move(range).Release();
+    }
+    template <typename Range>
+    constexpr auto MakeAddressOf(DereferenceRange<Range> range,
+                                 std::false_type /* raw pointers */) {
+      return MakeAddressOf<DereferenceRange<Range>>(std::move(range));
+    }
+
+    // Ranges which can't be walked backwards are buffered first.
+    template <typename Range>
+    constexpr auto MakeReverse(Range range) {
+      return MakeReverse(std::move(range), std::integral_constant<
+          bool, HasCategory<std::bidirectional_iterator_tag, Range>()>());
+    }
+    template <typename Range>
+    constexpr auto MakeReverse(Range range, std::true_type /* bidirectional */) {
+      return ReverseRange<Range>(std::move(range));
+    }
+    template <typename Range>
+    constexpr auto MakeReverse(Range range,
+                               std::false_type /* bidirectional */) {
+      return SortedRange<Range, ReversedComparator<OriginalOrder>>(
+          std::move(range), Reversed(OriginalOrder()));
+    }
+    template <typename Range>
+    constexpr Range MakeReverse(ReverseRange<Range> range) {
+      return std::move(range).Release();
+    }
+    template <typename Range, typename Comparator, bool kByAddress>
+    constexpr auto MakeReverse(
+        SortedRange<Range, Comparator, kByAddress> range) {
+      return std::move(range).Reverse();
+    }
+
+    // Random-access ranges are sliced in O(1) instead of being stepped over.
+    template <typename Range>
+    constexpr auto MakeSkip(Range range, std::size_t count) {
+      return MakeSkip(std::move(range), count, std::integral_constant<
+          bool, HasCategory<std::random_access_iterator_tag, Range>()>());
+    }
+    template <typename Range>
+    constexpr auto MakeSkip(Range range, std::size_t count,
+                            std::true_type /* random access */) {
+      return SliceRange<Range>(std::move(range), 0,
+                               std::numeric_limits<std::size_t>::max())
+          .Skip(count);
+    }
+    template <typename Range>
+    auto MakeSkip(Range range, std::size_t count,
+                  std::false_type /* random access */) {
+      return SkipRange<Range, CountSkipper>(std::move(range),
+                                            CountSkipper{count});
+    }
+    template <typename Range>
+    constexpr auto MakeSkip(SliceRange<Range> range, std::size_t count) {
+      return std::move(range).Skip(count);
+    }
+
+    template <typename Range>
+    constexpr auto MakeTake(Range range, std::size_t count) {
+      return MakeTake(std::move(range), count, std::integral_constant<
+          bool, HasCategory<std::random_access_iterator_tag, Range>()>());
+    }
+    template <typename Range>
+    constexpr auto MakeTake(Range range, std::size_t count,
+                            std::true_type /* random access */) {
+      return SliceRange<Range>(std::move(range), 0, count);
+    }
+    template <typename Range>
+    constexpr auto MakeTake(Range range, std::size_t count,
+                            std::false_type /* random access */) {
+      return TakeRange<Range>(std::move(range), count);
+    }
+    template <typename Range>
+    constexpr auto MakeTake(SliceRange<Range> range, std::size_t count) {
+      return std::move(range).Take(count);
+    }
 
     // RamanWrapper wraps a Range with functions that allow manipulating it, such
     // as Where(), Reverse(), etc.
@@ -548,37 +5569,47 @@ namespace raman {
     // From(x).Where().Sort()), and thus all methods only exist for rvalues.
     template <typename Range>
     struct RamanWrapper {
-      explicit RamanWrapper(Range range)
+      using iterator = typename Range::iterator;
+
+      constexpr explicit RamanWrapper(Range range)
         : range_(std::move(range)) {}
 
       RamanWrapper(RamanWrapper&&) = default;
       RamanWrapper& operator=(RamanWrapper&&) = default;
 
       template <typename Filter>
-      auto Where(Filter filter) && {
-        using InnerRange = FilteredRange<Range, Filter>;
-        return RamanWrapper<InnerRange>(InnerRange(
-              std::move(range_), std::move(filter)));
+      constexpr auto Where(Filter filter) && {
+        return Wrap(MakeWhere(std::move(range_), std::move(filter)));
+      }
+
+      // Like Where(), but `filter` decides for blocks of up to 64 elements
+      // at once, so that costly checks with batch interfaces (lookups,
+      // probes, matchers) are amortized over them. It's called with
+      // iterators to the block, and returns a std::uint64_t mask of the
+      // elements it accepts, bit i standing for element i:
+      // raman::From(keys).WhereBatch([&](auto begin, auto end) {
+      //   return cache.ContainsAll(begin, end); });
+      // Single-pass ranges are read a block ahead, and their elements copied
+      // into it.
+      template <typename Filter>
+      auto WhereBatch(Filter filter) && {
+        using Filtered = BatchFilteredRange<Range, Filter>;
+        return Wrap(Filtered(std::move(range_), std::move(filter)));
       }
 
       template <typename Transformer>
-      auto Transform(Transformer transformer) && {
-        using InnerRange = ByValueTransformerRange<Range, Transformer>;
-        return RamanWrapper<InnerRange>(
-            InnerRange(std::move(range_), std::move(transformer)));
+      constexpr auto Transform(Transformer transformer) && {
+        return Wrap(MakeTransform(std::move(range_), std::move(transformer)));
       }
 
-      auto Keys() && {
+      constexpr auto Keys() && {
         auto transformer = [](const ValueType<Range>& entry) {
           return entry.first;
         };
-        using InnerRange =
-            ByValueTransformerRange<Range, decltype(transformer)>;
-        return RamanWrapper<InnerRange>(
-            InnerRange(std::move(range_), std::move(transformer)));
+        return Wrap(MakeTransform(std::move(range_), std::move(transformer)));
       }
 
-      auto Values() && {
+      constexpr auto Values() && {
         auto transformer = [](ValueType<Range>& entry) -> auto& {
           return entry.second;
         };
@@ -587,116 +5618,766 @@ namespace raman {
             InnerRange(std::move(range_), std::move(transformer)));
       }
 
-      auto Dereference() && {
-        using InnerRange = DereferenceRange<Range>;
-        return RamanWrapper<InnerRange>(InnerRange(std::move(range_)));
+      constexpr auto Dereference() && {
+        return Wrap(MakeDereference(std::move(range_)));
       }
 
-      auto AddressOf() && {
-        auto transformer = [](ValueType<Range>& entry) { return &entry; };
-        using InnerRange =
-            ByValueTransformerRange<Range, decltype(transformer)>;
-        return RamanWrapper<InnerRange>(
-            InnerRange(std::move(range_), std::move(transformer)));
+      constexpr auto AddressOf() && {
+        return Wrap(MakeAddressOf(std::move(range_)));
       }
 
-      auto Reverse() && {
-        using InnerRange = ReverseRange<Range>;
-        return RamanWrapper<InnerRange>(InnerRange(std::move(range_)));
+      // Ranges which can't be walked backwards (like forward_list or
+      // istream_iterator) are buffered first.
+      constexpr auto Reverse() && {
+        return Wrap(MakeReverse(std::move(range_)));
+      }
+
+      // Collects statistics of the preceding stages: the number of elements
+      // they produced, and the cycles it took. Statistics are reported to
+      // `stats` if given, or to the callback set by SetStatsCallback()
+      // otherwise, when the range is destroyed. Place probes between stages
+      // to attribute time and selectivity to each of them.
+      // This does nothing unless RAMAN_ENABLE_STATS is defined.
+      auto Probe(const char* name, StageStats* stats = nullptr) && {
+#ifdef RAMAN_ENABLE_STATS
+        using InnerRange = ProbeRange<Range>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), name, stats));
+#else
+        return std::move(*this);
+#endif
+      }
+
+      // Iterates over the range on a background thread, up to `capacity`
+      // elements ahead of the consumer, so that expensive upstream stages
+      // (parsing, heavy Transform()s, ...) overlap with the loop body.
+      // Elements which outlive the iteration step (see IsAddressable()) are
+      // handed over by reference, others by value. Breaking out of the loop
+      // early stops the background thread once the range is destroyed.
+      // The upstream stages must not touch state shared with the loop body.
+      auto Prefetch(std::size_t capacity) && {
+        using InnerRange = PrefetchRange<Range>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), capacity));
+      }
+
+      // Captures the pipeline's position, to take its results a page at a
+      // time, later on, without running it again from the start:
+      // auto cursor = raman::From(items).Where(IsVisible).Sort().Cursor();
+      // vector<Item> first_page = cursor.Next(20);
+      // ... and later on, from the same cursor:
+      // vector<Item> second_page = cursor.Next(20);
+      // Stages run only as far as the pages taken require (up to the
+      // element after them), except Sort() and others which buffer the
+      // range. Like with Prefetch(), elements
+      // the wrapper refers to must outlive the cursor.
+      auto Cursor() && { return RangeCursor<Range>(std::move(range_)); }
+
+      // Running results of `operation`, starting from `init`, before each
+      // element is added, like std::exclusive_scan: sizes become offsets.
+      // vector<size_t> offsets = raman::From(sizes).Scan(size_t(0));
+      template <typename T, typename Operation = std::plus<>>
+      auto Scan(T init, Operation operation = Operation()) && {
+        using Scanned = ScanRange<Range, T, Operation, false>;
+        Optional<T> start;
+        start.Emplace(std::move(init));
+        return Wrap(Scanned(std::move(range_), std::move(start),
+                            std::move(operation)));
+      }
+
+      // Running results of `operation`, from the first element on, like
+      // std::inclusive_scan: yields running totals, or maxima with
+      // InclusiveScan([](int a, int b) { return std::max(a, b); }).
+      template <typename Operation = std::plus<>>
+      auto InclusiveScan(Operation operation = Operation()) && {
+        using T = StorableValueType<Range>;
+        using Scanned = ScanRange<Range, T, Operation, true>;
+        return Wrap(Scanned(std::move(range_), Optional<T>(),
+                            std::move(operation)));
+      }
+
+      // Scan(init, operation) into a vector, for large random-access
+      // ranges, computed by `threads` threads (by default, one per core),
+      // each reading the range twice over a block of it. `operation` must
+      // be associative and is applied to pairs of results, so elements must
+      // convert to T, which must be default-constructible; it's called, and
+      // the range's stages run, concurrently.
+      template <typename T, typename Operation = std::plus<>>
+      std::vector<T> ParallelScan(T init, Operation operation = Operation(),
+                                  std::size_t threads = 0) && {
+        static_assert(HasCategory<std::random_access_iterator_tag, Range>(),
+                      "ParallelScan() needs a random-access range");
+        if (threads == 0) {
+          threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        auto begin = range_.begin();
+        std::vector<T> result(static_cast<std::size_t>(range_.end() - begin));
+        ParallelExclusiveScan(begin, result.size(), std::move(init),
+                              operation, threads, result.data());
+        return result;
       }
 
       // Iterates over the range in a sorted fashion, while returning a
       // reference to each of the values of the original list. You may modify
       // values unless otherwise limited.
-      // TODO: This does not yet occur lazily.
-      auto Sort() && {
-        return std::move(*this).Sort(std::less<ValueType<Range>>());
+      // Elements of single-pass ranges, or ones produced by Transform(), are
+      // sorted by value instead, in which case modifications are not
+      // reflected in the original range.
+      // Nothing is buffered until the range is iterated.
+      constexpr auto Sort() && {
+        return std::move(*this).Sort(std::less<StorableValueType<Range>>());
       }
       template <typename Comparator>
-      auto Sort(Comparator comparator) && {
-        using Pointer = ValueType<Range>*;
-        using TmpVector = std::vector<Pointer>;
-        TmpVector v;
-        for (auto& value : *this) {
-          v.push_back(&value);
-        }
-        std::sort(v.begin(), v.end(), [&](Pointer a, Pointer b) {
-          return comparator(*a, *b);
-        });
+      constexpr auto Sort(Comparator comparator) && {
+        using InnerRange = SortedRange<Range, Comparator>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), std::move(comparator)));
+      }
 
-        // Owns both sorted and unsorted ranges.
-        struct OwnerRange : internal::SimpleRangeOwner<TmpVector> {
-          OwnerRange(TmpVector&& sorted, Range range)
-            : internal::SimpleRangeOwner<TmpVector>(std::move(sorted)),
-              range_(std::move(range)) {}
+      // Stops after `count` elements. Single-pass ranges (like
+      // istream_iterator or Generate()) aren't read past the last of them.
+      // Random-access ranges (like vectors or the result of Sort(), but not
+      // after Where()) are sliced in O(1), so From(v).Skip(page * size)
+      // .Take(size) doesn't walk the preceding pages.
+      constexpr auto Take(std::size_t count) && {
+        return Wrap(MakeTake(std::move(range_), count));
+      }
 
-          OwnerRange(OwnerRange&&) = default;
-          OwnerRange& operator=(OwnerRange&&) = default;
+      // Starts after the first `count` elements.
+      constexpr auto Skip(std::size_t count) && {
+        return Wrap(MakeSkip(std::move(range_), count));
+      }
 
-         protected:
-          Range range_;
-        };
+      // Stops at the first element `predicate` rejects.
+      template <typename Predicate>
+      constexpr auto TakeWhile(Predicate predicate) && {
+        using InnerRange = TakeWhileRange<Range, Predicate>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), std::move(predicate)));
+      }
+
+      // Starts at the first element `predicate` rejects.
+      template <typename Predicate>
+      auto SkipWhile(Predicate predicate) && {
+        using InnerRange = SkipRange<Range, PredicateSkipper<Predicate>>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_),
+              PredicateSkipper<Predicate>(std::move(predicate))));
+      }
+
+      // Elements of `others` (containers or wrappers) after those of this
+      // range, without copying any of them:
+      // for (const Order& order : raman::From(open).Concat(closed)) { ... }
+      template <typename... Others>
+      constexpr auto Concat(Others&&... others) && {
+        using InnerRange = ConcatRange<
+            Range, decltype(ToRange(std::forward<Others>(others)))...>;
+        return RamanWrapper<InnerRange>(InnerRange(
+            std::move(range_), ToRange(std::forward<Others>(others))...));
+      }
+
+      // Elements of the ranges `mapper` returns for each element, one range
+      // after the other (SelectMany() in other libraries). Ranges returned
+      // by reference are walked in place, and the result may be reversed:
+      // FlatMap([](Order& order) -> auto& { return order.items; })
+      // Ranges returned by value, like wrappers, are held while walked, and
+      // the result can only be iterated once.
+      template <typename Mapper>
+      constexpr auto FlatMap(Mapper mapper) && {
+        using InnerRange = FlatMapRange<Range, Mapper>;
+        return RamanWrapper<InnerRange>(
+            InnerRange(std::move(range_), std::move(mapper)));
+      }
+
+      // Elements of the elements of a range of ranges, like
+      // vector<vector<int>>.
+      constexpr auto Flatten() && {
+        return std::move(*this).FlatMap(IdentityFunctor());
+      }
+
+      // Views of each `size` consecutive elements, one step apart: Window(3)
+      // yields views of [a, b, c], [b, c, d], ... Views refer to the range,
+      // so it must be multi-pass, and support begin(), end(), size(),
+      // front(), and back() and [] if the range does:
+      // raman::From(samples).Window(10).Transform(Average)
+      // Nothing is buffered, and the result is random-access if the range
+      // is.
+      constexpr auto Window(std::size_t size) && {
+        static_assert(HasCategory<std::forward_iterator_tag, Range>(),
+                      "Window() needs a multi-pass range");
+        using InnerRange = WindowRange<Range>;
+        return RamanWrapper<InnerRange>(InnerRange(std::move(range_), size));
+      }
+
+      // Like Window(), as tuples of references to each kSize consecutive
+      // elements.
+      template <std::size_t kSize>
+      constexpr auto Adjacent() && {
+        static_assert(HasCategory<std::forward_iterator_tag, Range>(),
+                      "Adjacent() needs a multi-pass range");
+        using InnerRange = AdjacentRange<Range, kSize>;
+        return RamanWrapper<InnerRange>(InnerRange(std::move(range_)));
+      }
+
+      // Each element with the next one, as tuples of references:
+      // for (auto [previous, next] : raman::From(samples).Pairwise()) { ... }
+      constexpr auto Pairwise() && {
+        return std::move(*this).template Adjacent<2>();
+      }
+
+      // This range's elements side by side with those of `others`
+      // (containers or wrappers), as tuples of references, up to the end of
+      // the shortest range:
+      // for (auto [name, age] : raman::From(names).Zip(ages)) { ... }
+      // Zips of random-access ranges are random-access too.
+      template <typename... Others>
+      constexpr auto Zip(Others&&... others) && {
+        static_assert(sizeof...(Others) > 0, "Zip() needs other ranges");
+        using InnerRange = ZipRange<
+            Range, decltype(ToRange(std::forward<Others>(others)))...>;
+        return RamanWrapper<InnerRange>(InnerRange(
+            std::move(range_), ToRange(std::forward<Others>(others))...));
+      }
+
+      // (index, element reference) pairs, indices starting at 0.
+      constexpr auto Enumerate() && {
+        using InnerRange = EnumerateRange<Range>;
+        return RamanWrapper<InnerRange>(InnerRange(std::move(range_)));
+      }
+
+      // Set operations with `other`, a container or wrapper, on ranges sorted
+      // by `comparator` (std::less by default). They produce the same
+      // elements as std::set_intersection() and friends, lazily: both ranges
+      // are walked in lockstep without buffering. Intersect() and Except()
+      // skip ahead in random-access ranges (like vectors, or the result of
+      // Sort()) with galloping search, so they are fast when one range is
+      // much smaller than the other.
+      template <typename Other, typename Comparator = std::less<>>
+      constexpr auto Intersect(Other&& other,
+                               Comparator comparator = Comparator()) && {
+        return std::move(*this).template Combine<SetOperation::kIntersect>(
+            ToRange(std::forward<Other>(other)), std::move(comparator));
+      }
+
+      template <typename Other, typename Comparator = std::less<>>
+      constexpr auto Union(Other&& other,
+                           Comparator comparator = Comparator()) && {
+        return std::move(*this).template Combine<SetOperation::kUnion>(
+            ToRange(std::forward<Other>(other)), std::move(comparator));
+      }
+
+      // Elements not in `other`.
+      template <typename Other, typename Comparator = std::less<>>
+      constexpr auto Except(Other&& other,
+                            Comparator comparator = Comparator()) && {
+        return std::move(*this).template Combine<SetOperation::kExcept>(
+            ToRange(std::forward<Other>(other)), std::move(comparator));
+      }
 
-        using DerefRange = DereferenceRange<OwnerRange>;
-        return RamanWrapper<DerefRange>(DerefRange(OwnerRange(
-            std::move(v), std::move(range_))));
+      template <typename Other, typename Comparator = std::less<>>
+      constexpr auto SymmetricDifference(
+          Other&& other, Comparator comparator = Comparator()) && {
+        return std::move(*this)
+            .template Combine<SetOperation::kSymmetricDifference>(
+                ToRange(std::forward<Other>(other)), std::move(comparator));
       }
 
       // Skips CONSECUTIVE identical items, like command line uniq.
       // Sort() first if you want global uniqueness.
-      auto Unique() && {
+      constexpr auto Unique() && {
         return std::move(*this).Unique(std::equal_to<ValueType<Range>>());
       }
       template <typename Comparator>
-      auto Unique(Comparator comparator) && {
-        using Value = ValueType<Range>;
+      constexpr auto Unique(Comparator comparator) && {
+        return std::move(*this).Unique(
+            std::move(comparator),
+            std::integral_constant<
+                bool, HasCategory<std::forward_iterator_tag, Range>()>());
+      }
 
-        struct Filter {
-          explicit Filter(Comparator comparator)
-            : comparator_(std::move(comparator)) {}
+      // Whether there are any elements.
+      constexpr bool Any() && {
+        return range_.begin() != range_.end();
+      }
 
-          bool operator()(const Value& value) const {
-            if (previous_ == nullptr) {
-              previous_ = &value;
-              return true;
-            }
-            bool equals_previous = comparator_(*previous_, value);
-            previous_ = &value;
-            return !equals_previous;
-          }
+      // The query terminals below stop at the first element which decides
+      // their result. On contiguous sources of numbers (like vector<int>),
+      // they test blocks of elements at once, so `predicate` may also be
+      // called on elements past that one, and must not have side effects.
+      template <typename Predicate>
+      constexpr bool Any(Predicate predicate) && {
+        return FindIf(range_, predicate) != range_.end();
+      }
 
-          mutable const Value* previous_ = nullptr;
-          Comparator comparator_;
+      template <typename Predicate>
+      constexpr bool All(Predicate predicate) && {
+        auto rejects = [&predicate](const auto& value) {
+          return !predicate(value);
         };
+        return FindIf(range_, rejects) == range_.end();
+      }
 
-        using InnerRange = FilteredRange<Range, Filter>;
-        return RamanWrapper<InnerRange>(InnerRange(
-              std::move(range_), std::move(Filter(std::move(comparator)))));
+      template <typename Predicate>
+      constexpr bool None(Predicate predicate) && {
+        return !std::move(*this).Any(std::move(predicate));
+      }
+
+      template <typename Value>
+      constexpr bool Contains(const Value& value) && {
+        return std::move(*this).Any(
+            [&value](const auto& element) { return element == value; });
+      }
+
+      // The first element, which must exist.
+      constexpr StorableValueType<Range> First() && {
+        auto it = range_.begin();
+        RAMAN_ASSERT(it != range_.end());
+        return *it;
+      }
+
+      template <typename Predicate>
+      constexpr StorableValueType<Range> First(Predicate predicate) && {
+        auto it = FindIf(range_, predicate);
+        RAMAN_ASSERT(it != range_.end());
+        return *it;
+      }
+
+      // The first element, or `default_value` if there are none.
+      constexpr StorableValueType<Range> FirstOrDefault(
+          StorableValueType<Range> default_value = {}) && {
+        auto it = range_.begin();
+        if (it == range_.end()) {
+          return default_value;
+        }
+        return *it;
+      }
+
+      template <typename Predicate>
+      constexpr StorableValueType<Range> FirstOrDefault(
+          Predicate predicate, StorableValueType<Range> default_value = {}) && {
+        auto it = FindIf(range_, predicate);
+        if (it == range_.end()) {
+          return default_value;
+        }
+        return *it;
+      }
+
+      // The address of the first element accepted by `predicate`, or nullptr.
+      // Like with AddressOf(), the elements must outlive the wrapper (so
+      // don't use it with From(temporary)).
+      template <typename Predicate>
+      constexpr ValueType<Range>* Find(Predicate predicate) && {
+        static_assert(IsAddressable<Range>(),
+                      "Find() needs elements with an address; "
+                      "use FirstOrDefault() instead");
+        auto it = FindIf(range_, predicate);
+        if (it == range_.end()) {
+          return nullptr;
+        }
+        return &*it;
+      }
+
+      // Feeds each element to several accumulators, in a single pass, and
+      // returns a tuple of their results:
+      // auto [count, total, worst] = raman::From(latencies).Where(IsValid)
+      //     .Aggregate(raman::Count(), raman::Sum(), raman::Max());
+      // Accumulators are held by value for the duration of the loop, so
+      // that the compiler may keep them in registers. Any type with
+      // Add(element) and Result() methods may be used as one.
+      template <typename... Accumulators>
+      constexpr auto Aggregate(Accumulators... accumulators) && {
+        auto bound = std::make_tuple(
+            BindAccumulator<StorableValueType<Range>>(
+                std::move(accumulators))...);
+        for (auto&& value : range_) {
+          AddToAll(bound, value, std::index_sequence_for<Accumulators...>());
+        }
+        return Results(std::move(bound),
+                       std::index_sequence_for<Accumulators...>());
+      }
+
+      // Aggregates of consecutive windows of `width` keys, which `key`
+      // returns for each element as an integer, like a timestamp. Keys must
+      // not decrease. Yields (window start, tuple of results) pairs, for
+      // windows holding elements; for per-second counts of events:
+      // raman::From(events).TumblingWindow(MillisOf, 1000, raman::Count())
+      // Accumulators work as in Aggregate(), as elements stream by, in O(1)
+      // per element and with a single set of them held at a time. The
+      // result can only be iterated once.
+      template <typename Key, typename... Accumulators>
+      auto TumblingWindow(
+          Key key, typename std::decay<TransformedType<Range, Key>>::type width,
+          Accumulators... accumulators) && {
+        return std::move(*this).template AggregateWindows<false>(
+            std::move(key), width, width, std::move(accumulators)...);
+      }
+
+      // Like TumblingWindow(), for windows of `width` keys starting every
+      // `step` keys, where `step` divides `width`: each window is made of
+      // width / step panes, aggregated once each and then merged, so
+      // accumulators need a Merge() method, like the built-in ones have.
+      // Elements are processed in O(1), windows in O(width / step), and
+      // the accumulators of width / step panes are held at a time.
+      template <typename Key, typename... Accumulators>
+      auto SlidingWindow(
+          Key key, typename std::decay<TransformedType<Range, Key>>::type width,
+          typename std::decay<TransformedType<Range, Key>>::type step,
+          Accumulators... accumulators) && {
+        return std::move(*this).template AggregateWindows<true>(
+            std::move(key), width, step, std::move(accumulators)...);
+      }
+
+      // Calls each of `sinks` with each element, in a single pass.
+      template <typename... Sinks>
+      constexpr void Tee(Sinks... sinks) && {
+        for (auto&& value : range_) {
+          int unused[] = {0, (sinks(value), 0)...};
+          (void)unused;
+        }
+      }
+
+      // Writes the elements to `sink`, each followed by `separator`, like
+      // std::ostream_iterator does, but several times faster: numbers are
+      // formatted without locales (with std::to_chars from C++17 on), into
+      // a 64KiB buffer passed on to `sink` in large blocks. `sink` is either
+      // a stream, or called with (data, size) and must write all of it:
+      // raman::From(ids).WriteTo(file);
+      // raman::From(ids).WriteTo([fd](const char* data, size_t size) {
+      //   WriteAll(fd, data, size); }, ",");
+      // Elements may be numbers, chars, C strings, or strings (anything with
+      // data() and size()).
+      template <typename Sink>
+      void WriteTo(Sink&& sink, const char* separator = "\n") && {
+        BufferedWriter<typename std::remove_reference<Sink>::type> writer(
+            sink);
+        std::size_t separator_size = std::strlen(separator);
+        for (auto&& value : range_) {
+          // Proxies, like those of vector<bool>, as their values.
+          Format(writer, static_cast<const typename std::iterator_traits<
+                             typename Range::iterator>::value_type&>(value));
+          writer.Write(separator, separator_size);
+        }
+        writer.Flush();
+      }
+
+      // A uniform random sample of `k` elements (or all of them, if fewer),
+      // in no particular order, drawn in a single pass in O(k) memory:
+      // vector<Record> sample = raman::From(records).Sample(100, rng);
+      // `rng` is a uniform random bit generator, like std::mt19937, and is
+      // called O(k log(n / k)) times for n elements. Random-access ranges
+      // only read the elements sampled (though not only the ones kept).
+      template <typename Rng>
+      std::vector<StorableValueType<Range>> Sample(std::size_t k,
+                                                   Rng&& rng) && {
+        ReservoirSampler<StorableValueType<Range>,
+                         typename std::remove_reference<Rng>::type>
+            sampler(k, rng);
+        SampleFrom(range_, sampler, std::integral_constant<
+            bool, HasCategory<std::random_access_iterator_tag, Range>()>());
+        return std::move(sampler).Result();
+      }
+
+      // Like Sample(k, rng), separately for each of `strata` groups of
+      // elements, the index of which `key` returns, as Histogram() does:
+      // vector<vector<Record>> samples = raman::From(records).SampleBy(
+      //     2, [](const Record& r) { return r.is_error ? 0 : 1; }, 10, rng);
+      // samples[i] holds up to `k` elements of group i.
+      template <typename Key, typename Rng>
+      std::vector<std::vector<StorableValueType<Range>>> SampleBy(
+          std::size_t strata, Key key, std::size_t k, Rng&& rng) && {
+        using Sampler = ReservoirSampler<
+            StorableValueType<Range>,
+            typename std::remove_reference<Rng>::type>;
+        std::vector<Sampler> samplers(strata, Sampler(k, rng));
+        for (auto&& value : range_) {
+          std::size_t index = static_cast<std::size_t>(key(value));
+          RAMAN_ASSERT(index < strata);
+          samplers[index].Add(value);
+        }
+        std::vector<std::vector<StorableValueType<Range>>> result;
+        result.reserve(strata);
+        for (Sampler& sampler : samplers) {
+          result.push_back(std::move(sampler).Result());
+        }
+        return result;
+      }
+
+      // Splits the elements into those accepted by `predicate` and the
+      // others, in a single pass, calling `predicate` once per element:
+      // auto [adults, minors] = raman::From(people).Partition(IsAdult);
+      // The containers (vectors by default) grow as elements are added, as
+      // reserving room for every element in both would waste half of it.
+      // Containers with room reserved can be passed in instead.
+      template <typename Container = std::vector<StorableValueType<Range>>,
+                typename Predicate>
+      std::pair<Container, Container> Partition(Predicate predicate) && {
+        std::pair<Container, Container> result;
+        std::move(*this).Partition(std::move(predicate), result.first,
+                                   result.second);
+        return result;
+      }
+
+      // Like Partition(predicate), appending to existing containers.
+      template <typename Predicate, typename Accepted, typename Rejected>
+      void Partition(Predicate predicate, Accepted& accepted,
+                     Rejected& rejected) && {
+        for (auto&& value : range_) {
+          if (predicate(value)) {
+            accepted.insert(accepted.end(), value);
+          } else {
+            rejected.insert(rejected.end(), value);
+          }
+        }
+      }
+      // Containers of the same type are picked without branching, as
+      // predicates are often unpredictable.
+      template <typename Predicate, typename Container>
+      void Partition(Predicate predicate, Container& accepted,
+                     Container& rejected) && {
+        for (auto&& value : range_) {
+          Container& container = predicate(value) ? accepted : rejected;
+          container.insert(container.end(), value);
+        }
+      }
+
+      // Distributes the elements into `count` buckets (vectors by default),
+      // in a single pass, by the bucket index in [0, count) which `key`
+      // returns for each of them:
+      // auto shards = raman::From(users).PartitionInto(8, ShardOf);
+      // Buckets get room for an even share of the elements, when their
+      // number is known in advance.
+      template <typename Container = std::vector<StorableValueType<Range>>,
+                typename Key>
+      std::vector<Container> PartitionInto(std::size_t count, Key key) && {
+        RAMAN_ASSERT(count > 0);
+        std::vector<Container> buckets(count);
+        std::size_t size = SizeHint(range_);
+        for (Container& bucket : buckets) {
+          ReserveIfPossible(bucket, size / count);
+        }
+        std::move(*this).PartitionInto(buckets, std::move(key));
+        return buckets;
+      }
+
+      // Like PartitionInto(count, key), appending to `buckets`: a
+      // random-access range of containers, like vector<vector<T>> or
+      // array<vector<T>, N>, which may have room reserved already.
+      template <typename Buckets, typename Key,
+                typename = typename std::enable_if<
+                    IsRange<Buckets>::value>::type>
+      void PartitionInto(Buckets& buckets, Key key) && {
+        auto begin = buckets.begin();
+        std::size_t count = static_cast<std::size_t>(buckets.end() - begin);
+        for (auto&& value : range_) {
+          std::size_t index = static_cast<std::size_t>(key(value));
+          RAMAN_ASSERT(index < count);
+          auto& bucket = begin[static_cast<std::ptrdiff_t>(index)];
+          bucket.insert(bucket.end(), value);
+        }
+        (void)count;
       }
 
-      auto begin() { return range_.begin(); }
-      auto end() { return range_.end(); }
+      constexpr auto begin() { return range_.begin(); }
+      constexpr auto end() { return range_.end(); }
 
-      // Implicit cast to any container.
+      // Implicit cast to any container. std::array is filled up to its size.
       // TODO: use std::move() if we own the container(?)
       template <typename Container>
-      operator Container() && {
-        Container container;
+      constexpr operator Container() && {
+        Container container{};
+        CopyTo(container, IsStdArray<Container>());
+        return container;
+      }
+
+     private:
+      template <typename Container>
+      constexpr void CopyTo(Container& container,
+                            std::false_type /* std::array */) {
+        ReserveIfPossible(container, SizeHint(range_));
         auto output_it = std::inserter(container, container.end());
         for (const auto& it : *this) {
           *output_it = it;
           ++output_it;
         }
-        return container;
       }
 
-     private:
+      template <typename Container>
+      constexpr void CopyTo(Container& container,
+                            std::true_type /* std::array */) {
+        std::size_t size = 0;
+        for (const auto& it : *this) {
+          RAMAN_ASSERT(size < container.size());
+          if (size == container.size()) {
+            break;
+          }
+          container[size++] = it;
+        }
+      }
+
+      template <typename Comparator>
+      constexpr auto Unique(Comparator comparator,
+                            std::true_type /* multi-pass */) && {
+        using InnerRange = UniqueRange<Range, Comparator>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), std::move(comparator)));
+      }
+
+      template <typename Comparator>
+      auto Unique(Comparator comparator, std::false_type /* multi-pass */) && {
+        using Filter = UniqueFilter<StorableValueType<Range>, Comparator>;
+        using InnerRange = FilteredRange<Range, Filter>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), Filter(std::move(comparator))));
+      }
+
+      template <bool kSliding, typename Key, typename KeyType,
+                typename... Accumulators>
+      auto AggregateWindows(Key key, KeyType width, KeyType step,
+                            Accumulators... accumulators) && {
+        static_assert(sizeof...(Accumulators) > 0, "Nothing to aggregate");
+        using InnerRange =
+            WindowAggregateRange<Range, Key, kSliding, Accumulators...>;
+        return RamanWrapper<InnerRange>(InnerRange(
+            std::move(range_), std::move(key), width, step,
+            std::move(accumulators)...));
+      }
+
+      template <SetOperation kOperation, typename Other, typename Comparator>
+      constexpr auto Combine(Other other, Comparator comparator) && {
+        using InnerRange =
+            SetOperationRange<Range, Other, Comparator, kOperation>;
+        return RamanWrapper<InnerRange>(InnerRange(
+              std::move(range_), std::move(other), std::move(comparator)));
+      }
+
+      template <typename InnerRange>
+      static constexpr auto Wrap(InnerRange range) {
+        return RamanWrapper<InnerRange>(std::move(range));
+      }
+
       Range range_;
     };
   }
 
+#ifdef RAMAN_HAS_COROUTINES
+  // Return type for coroutines producing a sequence of T's with co_yield,
+  // which may then be passed to raman::From(). Like istream_iterator, it can
+  // only be iterated once. Example:
+  // raman::Generator<int> Squares() { for (int i = 0;; ++i) co_yield i * i; }
+  // for (int i : raman::From(Squares()).Where(IsEven)) { ... }
+  template <typename T>
+  struct Generator {
+    struct promise_type {
+      Generator get_return_object() {
+        return Generator(Handle::from_promise(*this));
+      }
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+
+      // `value` outlives the suspension, so there's no need to copy it.
+      std::suspend_always yield_value(const T& value) noexcept {
+        value_ = std::addressof(value);
+        return {};
+      }
+
+      void return_void() {}
+
+      void unhandled_exception() {
+        exception_ = std::current_exception();
+      }
+
+      const T* value_ = nullptr;
+      std::exception_ptr exception_;
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct iterator {
+      // iterator typedefs.
+      using iterator_category = std::input_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const T*;
+      using reference = const T&;
+
+      explicit iterator(Handle handle = nullptr)
+        : handle_(handle) {}
+
+      const T& operator*() const {
+        RAMAN_ASSERT(!IsDone());
+        return *handle_.promise().value_;
+      }
+
+      iterator& operator++() {
+        RAMAN_ASSERT(!IsDone());
+        Resume(handle_);
+        return *this;
+      }
+
+      bool operator==(const iterator& o) const {
+        return IsDone() == o.IsDone();
+      }
+
+      bool operator!=(const iterator& o) const {
+        return !(*this == o);
+      }
+
+     private:
+      bool IsDone() const { return !handle_ || handle_.done(); }
+
+      Handle handle_;
+    };
+
+    explicit Generator(Handle handle)
+      : handle_(handle) {}
+
+    Generator(Generator&& o)
+      : handle_(std::exchange(o.handle_, nullptr)),
+        started_(o.started_) {}
+
+    Generator& operator=(Generator&& o) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(o.handle_, nullptr);
+      started_ = o.started_;
+      return *this;
+    }
+
+    ~Generator() {
+      if (handle_) {
+        handle_.destroy();
+      }
+    }
+
+    // Runs the coroutine up to its first co_yield.
+    iterator begin() {
+      if (!started_) {
+        started_ = true;
+        Resume(handle_);
+      }
+      return iterator(handle_);
+    }
+
+    iterator end() { return iterator(); }
+
+   private:
+    static void Resume(Handle handle) {
+      handle.resume();
+      if (handle.promise().exception_) {
+        std::rethrow_exception(
+            std::exchange(handle.promise().exception_, nullptr));
+      }
+    }
+
+    Handle handle_;
+    bool started_ = false;
+  };
+#endif
+
   template <typename Iterator>
-  auto From(Iterator begin, Iterator end) {
+  constexpr auto From(Iterator begin, Iterator end) {
     using Range = internal::SimpleRange<Iterator>;
     return internal::RamanWrapper<Range>(
         Range(std::move(begin), std::move(end)));
@@ -704,16 +6385,190 @@ namespace raman {
 
   // This version takes objects with lifetimes longer than the wrapper.
   template <typename Container>
-  auto From(Container& container) {
+  constexpr auto From(Container& container) {
     return From(container.begin(), container.end());
   }
 
   // This version keeps `container` alive while the wrapper is alive.
   template <typename Container>
-  auto From(Container&& container) {
+  constexpr auto From(Container&& container) {
     using Range = internal::SimpleRangeOwner<Container>;
     return internal::RamanWrapper<Range>(Range(std::move(container)));
   }
+
+  // Lazily produces begin, begin + 1, ..., end - 1, without storing them.
+  template <typename T>
+  constexpr auto Iota(T begin, T end) {
+    using Range = internal::IotaRange<T>;
+    return internal::RamanWrapper<Range>(Range(std::move(begin),
+                                               std::move(end)));
+  }
+
+  // Lazily produces the values returned by calling `generator` `count` times.
+  template <typename Generator>
+  auto Generate(Generator generator, std::size_t count) {
+    using Range = internal::GeneratedRange<Generator>;
+    return internal::RamanWrapper<Range>(Range(std::move(generator), count));
+  }
+
+  // Like the above, but never ends. Use Take(), TakeWhile() or `break` to stop
+  // iterating.
+  template <typename Generator>
+  auto Generate(Generator generator) {
+    return Generate(std::move(generator),
+                    std::numeric_limits<std::size_t>::max());
+  }
+
+#ifdef RAMAN_HAS_CHARCONV
+  // How FromCsv() reads its text.
+  struct CsvOptions {
+    char separator = ',';
+    // Whether the first line holds column names, rather than a row.
+    bool has_header = false;
+  };
+
+  // Lazily parses rows of CSV (or, with a '\t' separator, TSV) text into
+  // tuples of Types, without copying the text:
+  // for (auto [id, name, score] :
+  //      raman::FromCsv<int, std::string_view, double>(text)) { ... }
+  // `text` (anything with data() and size(), like a std::string or a
+  // memory-mapped file) must outlive the range, which std::string_view
+  // fields refer to. Quoted std::string_view fields keep escaped ("")
+  // quotes as they are in the text; std::string fields collapse them.
+  // Numbers are parsed with std::from_chars, so they may not be
+  // surrounded by spaces. Rows which don't parse are skipped.
+  template <typename... Types, typename Text>
+  auto FromCsv(const Text& text, CsvOptions options = CsvOptions()) {
+    static_assert(sizeof...(Types) > 0, "FromCsv() needs column types");
+    using Range = internal::CsvRange<Types...>;
+    const char* begin = text.data();
+    return internal::RamanWrapper<Range>(
+        Range(begin, begin + text.size(), options.separator,
+              options.has_header));
+  }
+  // Rows would refer to a temporary which owns its text, so
+  // raman::FromCsv<int>(ReadFile(path)) doesn't compile. Temporary views,
+  // like std::string_view, are fine.
+  template <typename... Types, typename Text,
+            typename = std::enable_if_t<
+                !std::is_lvalue_reference<Text>::value &&
+                !std::is_same<std::decay_t<Text>, std::string_view>::value>>
+  void FromCsv(Text&& text, CsvOptions options = CsvOptions()) = delete;
+#endif
+
+  namespace internal {
+    template <typename Comparator, typename First, typename... Rest>
+    auto MergeRanges(Comparator comparator, First&& first, Rest&&... rest) {
+      using Range = decltype(From(std::forward<First>(first)));
+      static_assert(
+          And(std::is_same<Range,
+                           decltype(From(std::forward<Rest>(rest)))>::value...),
+          "Merge() needs ranges of the same type");
+      std::vector<Range> ranges;
+      ranges.reserve(1 + sizeof...(Rest));
+      ranges.push_back(From(std::forward<First>(first)));
+      int unused[] = {
+          0, (ranges.push_back(From(std::forward<Rest>(rest))), 0)...};
+      (void)unused;
+      using InnerRange = MergeRange<Range, Comparator>;
+      return RamanWrapper<InnerRange>(InnerRange(std::move(ranges),
+                                                 std::move(comparator)));
+    }
+
+    template <typename Arguments, std::size_t... kIndices>
+    auto MergeArguments(Arguments arguments,
+                        std::index_sequence<kIndices...>,
+                        std::true_type /* ends with a range */) {
+      return MergeRanges(
+          std::less<>(), std::get<kIndices>(std::move(arguments))...,
+          std::get<sizeof...(kIndices)>(std::move(arguments)));
+    }
+    template <typename Arguments, std::size_t... kIndices>
+    auto MergeArguments(Arguments arguments,
+                        std::index_sequence<kIndices...>,
+                        std::false_type /* ends with a range */) {
+      return MergeRanges(std::get<sizeof...(kIndices)>(std::move(arguments)),
+                         std::get<kIndices>(std::move(arguments))...);
+    }
+  }
+
+  // Lazily merges sorted ranges (containers, or wrappers returned by
+  // From() and friends) into one sorted range, in O(log k) per element for k
+  // ranges. The last argument may be the comparator the ranges are sorted by;
+  // std::less is used otherwise. All ranges must be of the same type, and
+  // the result can only be iterated once. Example:
+  // vector<int> all = raman::Merge(shard1, shard2, shard3);
+  template <typename... Arguments>
+  auto Merge(Arguments&&... arguments) {
+    using Last = typename std::tuple_element<
+        sizeof...(Arguments) - 1, std::tuple<Arguments...>>::type;
+    return internal::MergeArguments(
+        std::forward_as_tuple(std::forward<Arguments>(arguments)...),
+        std::make_index_sequence<sizeof...(Arguments) - 1>(),
+        internal::IsRange<typename std::remove_reference<Last>::type>());
+  }
+
+  // Accumulators for Aggregate(). Sum(), Min() and Max() hold values of the
+  // elements' type, unless given another one, like Sum<long long>().
+  constexpr internal::CountAccumulator Count() { return {}; }
+
+  template <typename T = void>
+  constexpr internal::SumAccumulator<T> Sum() {
+    return internal::SumAccumulator<T>();
+  }
+
+  // The smallest element, or T() if there are none.
+  template <typename T = void, typename Comparator = std::less<>>
+  constexpr auto Min(Comparator comparator = Comparator()) {
+    return internal::MinAccumulator<T, Comparator>(std::move(comparator));
+  }
+
+  // The largest element, or T() if there are none.
+  template <typename T = void, typename Comparator = std::less<>>
+  constexpr auto Max(Comparator comparator = Comparator()) {
+    using Reversed = internal::ReversedComparator<Comparator>;
+    return internal::MinAccumulator<T, Reversed>(
+        Reversed(std::move(comparator)));
+  }
+
+  // Feeds what `projection` returns for each element to `accumulator`:
+  // raman::Of([](const Event& e) { return e.latency; }, raman::Max())
+  template <typename Projection, typename Accumulator>
+  constexpr auto Of(Projection projection, Accumulator accumulator) {
+    return internal::ProjectedAccumulator<Projection, Accumulator>(
+        std::move(projection), std::move(accumulator));
+  }
+
+  // Counts of elements by the index in [0, buckets) which `key` returns.
+  template <typename Key>
+  auto Histogram(std::size_t buckets, Key key) {
+    return internal::HistogramAccumulator<Key>(buckets, std::move(key));
+  }
+
+  // Lazily walks ranges (containers, or wrappers returned by From() and
+  // friends) one after the other. Example:
+  // for (int i : raman::Concat(head, middle, tail)) { ... }
+  template <typename First, typename... Rest>
+  constexpr auto Concat(First&& first, Rest&&... rest) {
+    return From(std::forward<First>(first))
+        .Concat(std::forward<Rest>(rest)...);
+  }
+
+  // Like Merge(), for a range of sorted containers, like
+  // vector<vector<int>>. The containers are referred to, so they must
+  // outlive the result.
+  template <typename Ranges, typename Comparator = std::less<>>
+  auto MergeAll(Ranges& ranges, Comparator comparator = Comparator()) {
+    using Range = decltype(From(*ranges.begin()));
+    std::vector<Range> inner_ranges;
+    internal::ReserveIfPossible(inner_ranges, internal::SizeHint(ranges));
+    for (auto& inner : ranges) {
+      inner_ranges.push_back(From(inner));
+    }
+    using InnerRange = internal::MergeRange<Range, Comparator>;
+    return internal::RamanWrapper<InnerRange>(
+        InnerRange(std::move(inner_ranges), std::move(comparator)));
+  }
 }
 
 #endif  //RAMAN_CONTAINERS_LIBRARY
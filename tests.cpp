@@ -1,22 +1,41 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <forward_list>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <map>
 #include <memory>
+#include <new>
+#include <random>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 #define RAMAN_ENABLE_RUNTIME_ASSERT
+#define RAMAN_ENABLE_STATS
 #include "raman.hpp"
 
 using std::array;
 using std::deque;
+using std::forward_list;
+using std::istream_iterator;
+using std::istringstream;
 using std::list;
 using std::map;
 using std::set;
@@ -26,7 +45,126 @@ using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
+// Counts heap allocations, to verify that lazy stages don't allocate. The
+// whole family of global allocation functions is replaced, so that memory
+// is always released by the counterpart of what allocated it.
 namespace {
+  std::atomic<size_t> allocation_count(0);
+
+  // Returns nullptr on failure.
+  void* CountedAllocate(size_t size) noexcept {
+    ++allocation_count;
+    return std::malloc(size == 0 ? 1 : size);
+  }
+
+  void* CountedAllocateOrThrow(size_t size) {
+    if (void* p = CountedAllocate(size)) {
+      return p;
+    }
+    throw std::bad_alloc();
+  }
+
+  void CountedFree(void* p) noexcept { std::free(p); }
+
+#ifdef __cpp_aligned_new
+  // Over-allocates, and keeps what malloc() returned right before the
+  // aligned block.
+  void* CountedAllocateAligned(size_t size, std::align_val_t align) noexcept {
+    size_t alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+    void* raw = CountedAllocate(size + alignment + sizeof(void*));
+    if (raw == nullptr) {
+      return nullptr;
+    }
+    std::uintptr_t start =
+        reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+    void* aligned = reinterpret_cast<void*>(
+        (start + alignment - 1) / alignment * alignment);
+    static_cast<void**>(aligned)[-1] = raw;
+    return aligned;
+  }
+
+  void* CountedAllocateAlignedOrThrow(size_t size, std::align_val_t align) {
+    if (void* p = CountedAllocateAligned(size, align)) {
+      return p;
+    }
+    throw std::bad_alloc();
+  }
+
+  void CountedFreeAligned(void* p) noexcept {
+    if (p != nullptr) {
+      std::free(static_cast<void**>(p)[-1]);
+    }
+  }
+#endif
+}
+
+void* operator new(size_t size) { return CountedAllocateOrThrow(size); }
+void* operator new[](size_t size) { return CountedAllocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size);
+}
+
+void operator delete(void* p) noexcept { CountedFree(p); }
+void operator delete[](void* p) noexcept { CountedFree(p); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  CountedFree(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  CountedFree(p);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t align) {
+  return CountedAllocateAlignedOrThrow(size, align);
+}
+void* operator new[](size_t size, std::align_val_t align) {
+  return CountedAllocateAlignedOrThrow(size, align);
+}
+void* operator new(size_t size, std::align_val_t align,
+                   const std::nothrow_t&) noexcept {
+  return CountedAllocateAligned(size, align);
+}
+void* operator new[](size_t size, std::align_val_t align,
+                     const std::nothrow_t&) noexcept {
+  return CountedAllocateAligned(size, align);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  CountedFreeAligned(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept {
+  CountedFreeAligned(p);
+}
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  CountedFreeAligned(p);
+}
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  CountedFreeAligned(p);
+}
+void operator delete(void* p, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  CountedFreeAligned(p);
+}
+void operator delete[](void* p, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  CountedFreeAligned(p);
+}
+#endif
+
+namespace {
+  // Returns the number of heap allocations made by `fn`.
+  template <typename Fn>
+  size_t CountAllocations(Fn fn) {
+    size_t before = allocation_count;
+    fn();
+    return allocation_count - before;
+  }
+
   template <typename Container, typename Value>
   void AppendToContainer(Container& container, Value&& value) {
     container.insert(container.end(), std::forward<Value>(value));
@@ -774,6 +912,20 @@ TEST_CASE("Unique") {
     REQUIRE(out == vector<int>{3, 2, 1});
   }
 
+  {
+    vector<int> out = raman::From(vector<int>{1, 2, 2, 2, 3, 2})
+                        .Sort()
+                        .Unique()
+                        .Reverse();
+    REQUIRE(out == vector<int>{3, 2, 1});
+  }
+
+  {
+    vector<int> out =
+        raman::From(list<int>{1, 1, 2, 2, 2, 3, 2, 2}).Unique().Reverse();
+    REQUIRE(out == vector<int>{2, 3, 2, 1});
+  }
+
   {
     vector<string> out = raman::From(vector<string>{}).Unique();
     REQUIRE(out == vector<string>{});
@@ -812,3 +964,1941 @@ TEST_CASE("Unique") {
     REQUIRE(out == vector<string>{"3", "2", "1"});
   }
 }
+
+TEST_CASE("forward_list") {
+  {
+    forward_list<int> in = {1, 2, 3, 4, 5, 6};
+    vector<int> out = raman::From(in)
+                        .Where([](int i) { return i > 2; })
+                        .Transform([](int i) { return i * 2; });
+    REQUIRE(out == vector<int>{6, 8, 10, 12});
+  }
+
+  {
+    forward_list<int> in = {1, 1, 2, 2, 2, 3, 1};
+    vector<int> out = raman::From(in).Unique();
+    REQUIRE(out == vector<int>{1, 2, 3, 1});
+  }
+
+  {
+    forward_list<int> in = {1, 2, 3, 4};
+    vector<int> out = raman::From(in).Reverse();
+    REQUIRE(out == vector<int>{4, 3, 2, 1});
+  }
+
+  {
+    forward_list<int> v = {1, 2, 3, 4};
+    for (auto& i : raman::From(v).Where([](int i) { return i > 2; })
+                                  .Reverse()) {
+      ++i;
+    }
+    REQUIRE(v == forward_list<int>{1, 2, 4, 5});
+  }
+
+  {
+    forward_list<string> v = {"3", "1", "2"};
+    vector<string> out;
+    for (auto& s : raman::From(v).Sort().Reverse()) {
+      out.push_back(s);
+      s += "!";
+    }
+    REQUIRE(out == vector<string>{"3", "2", "1"});
+    REQUIRE(v == forward_list<string>{"3!", "1!", "2!"});
+  }
+
+  {
+    forward_list<int> in;
+    vector<int> out = raman::From(in).Reverse().Sort().Unique();
+    REQUIRE(out == vector<int>{});
+  }
+}
+
+TEST_CASE("input iterators") {
+  {
+    istringstream stream("1 2 3 4 5 6");
+    vector<int> out =
+        raman::From(istream_iterator<int>(stream), istream_iterator<int>())
+          .Where([](int i) { return i % 2 == 0; })
+          .Transform([](int i) { return i * 10; });
+    REQUIRE(out == vector<int>{20, 40, 60});
+  }
+
+  {
+    istringstream stream("1 1 2 2 2 3 1 1");
+    vector<int> out =
+        raman::From(istream_iterator<int>(stream), istream_iterator<int>())
+          .Unique();
+    REQUIRE(out == vector<int>{1, 2, 3, 1});
+  }
+
+  {
+    istringstream stream("one two three");
+    vector<string> out =
+        raman::From(istream_iterator<string>(stream),
+                    istream_iterator<string>())
+          .Reverse();
+    REQUIRE(out == vector<string>{"three", "two", "one"});
+  }
+
+  {
+    istringstream stream("3 1 2 3 1");
+    vector<int> out =
+        raman::From(istream_iterator<int>(stream), istream_iterator<int>())
+          .Sort()
+          .Unique()
+          .Reverse();
+    REQUIRE(out == vector<int>{3, 2, 1});
+  }
+
+  {
+    istringstream stream("3 1 2 3 1");
+    set<int> out =
+        raman::From(istream_iterator<int>(stream), istream_iterator<int>());
+    REQUIRE(out == set<int>{1, 2, 3});
+  }
+
+  {
+    istringstream stream("");
+    vector<int> out =
+        raman::From(istream_iterator<int>(stream), istream_iterator<int>())
+          .Where([](int i) { return i > 0; })
+          .Reverse();
+    REQUIRE(out == vector<int>{});
+  }
+}
+
+TEST_CASE("pointers as iterators") {
+  int in[] = {1, 2, 3, 4, 5};
+  vector<int> out = raman::From(in, in + 5)
+                      .Where([](int i) { return i > 1; })
+                      .Reverse();
+  REQUIRE(out == vector<int>{5, 4, 3, 2});
+}
+
+TEST_CASE("Sort & Unique after Transform") {
+  vector<int> in = {5, 1, 4, 2, 3};
+
+  {
+    vector<int> out =
+        raman::From(in).Transform([](int i) { return i / 2; }).Unique();
+    REQUIRE(out == vector<int>{2, 0, 2, 1});
+  }
+
+  {
+    vector<int> out = raman::From(in)
+                        .Transform([](int i) { return i / 2; })
+                        .Sort()
+                        .Unique();
+    REQUIRE(out == vector<int>{0, 1, 2});
+  }
+}
+
+TEST_CASE("Iota") {
+  {
+    vector<int> out = raman::Iota(0, 5);
+    REQUIRE(out == vector<int>{0, 1, 2, 3, 4});
+  }
+
+  {
+    vector<int> out = raman::Iota(3, 3);
+    REQUIRE(out == vector<int>{});
+  }
+
+  {
+    vector<size_t> out = raman::Iota<size_t>(0, 10)
+                           .Where([](size_t i) { return i % 3 == 0; })
+                           .Reverse();
+    REQUIRE(out == vector<size_t>{9, 6, 3, 0});
+  }
+
+  {
+    vector<int> out = raman::Iota(0, 6)
+                        .Transform([](int i) { return i / 2; })
+                        .Unique()
+                        .Reverse();
+    REQUIRE(out == vector<int>{2, 1, 0});
+  }
+
+  {
+    vector<int> out = raman::Iota(0, 4)
+                        .Sort([](int a, int b) { return a > b; });
+    REQUIRE(out == vector<int>{3, 2, 1, 0});
+  }
+
+  {
+    // Iterators support all of random access.
+    auto range = raman::Iota(0, 10);
+    auto begin = range.begin();
+    auto end = range.end();
+    REQUIRE(end > begin);
+    REQUIRE(begin <= begin);
+    REQUIRE(end >= begin);
+    REQUIRE(!(begin > end));
+    REQUIRE(*(2 + begin) == 2);
+    REQUIRE(*begin++ == 0);
+    REQUIRE(*begin-- == 1);
+    REQUIRE(*begin == 0);
+#ifdef __cpp_lib_ranges
+    static_assert(std::random_access_iterator<decltype(begin)>, "");
+#endif
+  }
+}
+
+TEST_CASE("Generate") {
+  {
+    int next = 1;
+    vector<int> out = raman::Generate([&next]() { return next *= 2; }, 4);
+    REQUIRE(out == vector<int>{2, 4, 8, 16});
+  }
+
+  {
+    vector<string> out = raman::Generate([]() { return string("x"); }, 0);
+    REQUIRE(out == vector<string>{});
+  }
+
+  {
+    int next = 0;
+    vector<int> out;
+    for (int i : raman::Generate([&next]() { return next++; })
+                   .Where([](int i) { return i % 2 == 1; })) {
+      if (i > 7) {
+        break;
+      }
+      out.push_back(i);
+    }
+    REQUIRE(out == vector<int>{1, 3, 5, 7});
+  }
+
+  {
+    int next = 0;
+    vector<int> out = raman::Generate([&next]() { return next++ / 2; }, 6)
+                        .Unique()
+                        .Reverse();
+    REQUIRE(out == vector<int>{2, 1, 0});
+  }
+}
+
+TEST_CASE("Prefetch") {
+  {
+    vector<int> in = raman::Iota(0, 1000);
+    vector<int> out = raman::From(in)
+                        .Transform([](int i) { return i * 2; })
+                        .Prefetch(16)
+                        .Where([](int i) { return i % 3 == 0; });
+    vector<int> expected = raman::From(in)
+                             .Transform([](int i) { return i * 2; })
+                             .Where([](int i) { return i % 3 == 0; });
+    REQUIRE(out == expected);
+  }
+
+  {
+    vector<int> out = raman::From(vector<int>{}).Prefetch(4);
+    REQUIRE(out == vector<int>{});
+  }
+
+  {
+    vector<string> out =
+        raman::From(vector<string>{"one", "two", "three"}).Prefetch(1);
+    REQUIRE(out == vector<string>{"one", "two", "three"});
+  }
+
+  {
+    vector<int> v = {1, 2, 3, 4};
+    for (auto& i : raman::From(v).Where([](int i) { return i > 2; })
+                                 .Prefetch(2)) {
+      ++i;
+    }
+    REQUIRE(v == vector<int>{1, 2, 4, 5});
+  }
+
+  {
+    int next = 0;
+    vector<int> out;
+    for (int i : raman::Generate([&next]() { return next++; }).Prefetch(8)) {
+      if (i == 100) {
+        break;
+      }
+      out.push_back(i);
+    }
+    vector<int> expected = raman::Iota(0, 100);
+    REQUIRE(out == expected);
+  }
+
+  {
+    auto consume = []() {
+      vector<int> out = raman::Iota(0, 10)
+                          .Transform([](int i) {
+                            if (i == 5) {
+                              throw std::runtime_error("five");
+                            }
+                            return i;
+                          })
+                          .Prefetch(2);
+    };
+    REQUIRE_THROWS_AS(consume(), std::runtime_error);
+  }
+
+  {
+    vector<int> out = raman::From(vector<int>{3, 1, 2}).Prefetch(2).Sort();
+    REQUIRE(out == vector<int>{1, 2, 3});
+  }
+
+  {
+    // Assigning over a started range stops its background thread, which is
+    // blocked on a full ring.
+    auto prefetched = raman::Iota(0, 1000).Prefetch(2);
+    REQUIRE(*prefetched.begin() == 0);
+    prefetched = raman::Iota(5, 7).Prefetch(2);
+    vector<int> out = std::move(prefetched);
+    REQUIRE(out == vector<int>{5, 6});
+  }
+
+  {
+    // Waiting for a slow upstream stage blocks rather than spins.
+    std::clock_t cpu_start = std::clock();
+    int sum = 0;
+    for (int i : raman::Iota(0, 10)
+                     .Transform([](int i) {
+                       std::this_thread::sleep_for(
+                           std::chrono::milliseconds(30));
+                       return i;
+                     })
+                     .Prefetch(2)) {
+      sum += i;
+    }
+    REQUIRE(sum == 45);
+    double cpu_seconds =
+        static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    REQUIRE(cpu_seconds < 0.1);
+  }
+}
+
+TEST_CASE("Probe") {
+  vector<int> in = raman::Iota(0, 10);
+  raman::StageStats source, filtered;
+  {
+    vector<int> out = raman::From(in)
+                        .Probe("source", &source)
+                        .Where([](int i) { return i % 2 == 0; })
+                        .Probe("filtered", &filtered);
+    REQUIRE(out == vector<int>{0, 2, 4, 6, 8});
+  }
+  REQUIRE(string(source.name) == "source");
+  REQUIRE(source.elements_out == 10);
+  REQUIRE(string(filtered.name) == "filtered");
+  REQUIRE(filtered.elements_out == 5);
+}
+
+TEST_CASE("stats callback") {
+  vector<raman::StageStats> reported;
+  raman::SetStatsCallback([&reported](const raman::StageStats& stats) {
+    reported.push_back(stats);
+  });
+
+  {
+    vector<int> out = raman::Iota(0, 10)
+                        .Where([](int i) { return i < 4; })
+                        .Transform([](int i) { return i * 2; });
+    REQUIRE(out == vector<int>{0, 2, 4, 6});
+  }
+  raman::SetStatsCallback(nullptr);
+
+  REQUIRE(reported.size() == 2);
+  // Outer stages are destroyed first.
+  REQUIRE(string(reported[0].name) == "Transform");
+  REQUIRE(reported[0].calls == 4);
+  REQUIRE(reported[0].elements_out == 4);
+  REQUIRE(string(reported[1].name) == "Where");
+  REQUIRE(reported[1].calls == 10);
+  REQUIRE(reported[1].elements_in == 10);
+  REQUIRE(reported[1].elements_out == 4);
+  REQUIRE(reported[1].Selectivity() == Approx(0.4));
+}
+
+TEST_CASE("allocations are counted") {
+  // Keeps the compiler from eliding allocations which don't escape.
+  static void* volatile escaped;
+  REQUIRE(CountAllocations([]() {
+    int* p = new int(1);
+    escaped = p;
+    delete p;
+  }) == 1);
+  REQUIRE(CountAllocations([]() {
+    int* p = new int[3];
+    escaped = p;
+    delete[] p;
+  }) == 1);
+  REQUIRE(CountAllocations([]() {
+    int* p = new (std::nothrow) int(1);
+    escaped = p;
+    delete p;
+  }) == 1);
+#ifdef __cpp_aligned_new
+  struct alignas(64) Aligned {
+    char c;
+  };
+  REQUIRE(CountAllocations([]() {
+    Aligned* p = new Aligned();
+    escaped = p;
+    REQUIRE(reinterpret_cast<std::uintptr_t>(p) % 64 == 0);
+    delete p;
+  }) == 1);
+#endif
+}
+
+TEST_CASE("lazy stages don't allocate") {
+  const vector<int> in = raman::Iota(0, 1000);
+  const list<int> l(in.begin(), in.end());
+  map<int, int> m;
+  for (int i : in) {
+    m[i] = i;
+  }
+  vector<const int*> pointers = raman::From(in).AddressOf();
+  long sum = 0;
+
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(in).Where([](int i) { return i % 2 == 0; })) {
+      sum += i;
+    }
+  }) == 0);
+
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(in).Transform([](int i) { return i * 2; })) {
+      sum += i;
+    }
+  }) == 0);
+
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(m).Keys()) {
+      sum += i;
+    }
+    for (int i : raman::From(m).Values()) {
+      sum += i;
+    }
+  }) == 0);
+
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(pointers).Dereference()) {
+      sum += i;
+    }
+    for (const int* i : raman::From(in).AddressOf()) {
+      sum += *i;
+    }
+  }) == 0);
+
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(in).Reverse()) {
+      sum += i;
+    }
+    for (int i : raman::From(l).Reverse()) {
+      sum += i;
+    }
+  }) == 0);
+
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(in)
+                   .Transform([](int i) { return i / 3; })
+                   .Unique()
+                   .Where([](int i) { return i > 10; })
+                   .Reverse()) {
+      sum += i;
+    }
+  }) == 0);
+
+  REQUIRE(sum != 0);
+}
+
+TEST_CASE("Sort & conversions allocate only their buffers") {
+  const vector<int> in = raman::Iota(0, 1000);
+  long sum = 0;
+
+  // The buffer of pointers.
+  REQUIRE(CountAllocations([&]() {
+    for (int i : raman::From(in).Sort().Reverse()) {
+      sum += i;
+    }
+  }) == 1);
+
+  REQUIRE(CountAllocations([&]() {
+    vector<int> out = raman::From(in);
+    sum += out.size();
+  }) == 1);
+
+  // Nodes, and a single bucket array.
+  REQUIRE(CountAllocations([&]() {
+    unordered_set<int> out = raman::From(in);
+    sum += out.size();
+  }) == in.size() + 1);
+
+  REQUIRE(CountAllocations([&]() {
+    set<int> out = raman::From(in).Where([](int i) { return i < 10; });
+    sum += out.size();
+  }) == 10);
+
+  REQUIRE(sum != 0);
+}
+
+// Statistics are collected at runtime, so with RAMAN_ENABLE_STATS pipelines
+// are only constexpr from C++20 on.
+#if __cplusplus >= 201703L && \
+    (!defined(RAMAN_ENABLE_STATS) || defined(__cpp_lib_is_constant_evaluated))
+namespace {
+  constexpr array<int, 5> kSquaresOfEvens =
+      raman::Iota(0, 10)
+        .Where([](int i) { return i % 2 == 0; })
+        .Transform([](int i) { return i * i; });
+  static_assert(kSquaresOfEvens[0] == 0, "");
+  static_assert(kSquaresOfEvens[4] == 64, "");
+
+  constexpr array<int, 6> kInput = {1, 1, 3, 3, 4, 5};
+
+  constexpr int SumOfUniqueOdds() {
+    int sum = 0;
+    for (int i : raman::From(kInput)
+                   .Unique()
+                   .Where([](int i) { return i % 2 == 1; })) {
+      sum += i;
+    }
+    return sum;
+  }
+  static_assert(SumOfUniqueOdds() == 9, "");
+
+  constexpr array<int, 3> ReversedDoubled() {
+    return raman::From(array<int, 4>{1, 2, 3, 4})
+             .Reverse()
+             .Where([](int i) { return i > 1; })
+             .Transform([](int i) { return i * 2; });
+  }
+  static_assert(ReversedDoubled()[0] == 8, "");
+  static_assert(ReversedDoubled()[2] == 4, "");
+
+  constexpr array<std::pair<int, char>, 2> kPairs = {{{1, 'a'}, {2, 'b'}}};
+  constexpr array<char, 2> kValues = raman::From(kPairs).Values();
+  static_assert(kValues[1] == 'b', "");
+
+  constexpr array<int, 2> kPage = raman::Iota(0, 100)
+                                    .Skip(10)
+                                    .Take(2)
+                                    .TakeWhile([](int i) { return i < 50; });
+  static_assert(kPage[0] == 10 && kPage[1] == 11, "");
+
+#if defined(__cpp_lib_constexpr_vector) && \
+    defined(__cpp_lib_constexpr_algorithms)
+  constexpr array<int, 3> kSortedUnique =
+      raman::From(array<int, 5>{3, 1, 2, 3, 1}).Sort().Unique();
+  static_assert(kSortedUnique[0] == 1 && kSortedUnique[2] == 3, "");
+#endif
+}
+#endif
+
+TEST_CASE("Cast to std::array") {
+  {
+    array<int, 3> out = raman::From(vector<int>{1, 2, 3});
+    REQUIRE(out == (array<int, 3>{1, 2, 3}));
+  }
+
+  {
+    array<int, 4> out = raman::From(list<int>{1, 2});
+    REQUIRE(out == (array<int, 4>{1, 2, 0, 0}));
+  }
+
+  {
+    auto too_many = []() { (void)array<int, 2>(raman::Iota(0, 3)); };
+    REQUIRE_THROWS_AS(too_many(), std::runtime_error);
+  }
+}
+
+TEST_CASE("stage fusion") {
+  SECTION("Where().Where() is a single stage") {
+    vector<int> seen;
+    vector<int> out = raman::Iota(0, 10)
+                        .Where([](int i) { return i % 2 == 0; })
+                        .Where([&seen](int i) {
+                          seen.push_back(i);
+                          return i > 4;
+                        });
+    REQUIRE(out == vector<int>{6, 8});
+    REQUIRE(seen == vector<int>{0, 2, 4, 6, 8});
+
+    vector<raman::StageStats> reported;
+    raman::SetStatsCallback([&reported](const raman::StageStats& stats) {
+      reported.push_back(stats);
+    });
+    {
+      vector<int> fused = raman::Iota(0, 10)
+                            .Where([](int i) { return i % 2 == 0; })
+                            .Where([](int i) { return i > 4; })
+                            .Transform([](int i) { return i + 1; })
+                            .Transform([](int i) { return i * 10; });
+      REQUIRE(fused == vector<int>{70, 90});
+    }
+    raman::SetStatsCallback(nullptr);
+    REQUIRE(reported.size() == 2);
+    REQUIRE(string(reported[0].name) == "Transform");
+    REQUIRE(reported[0].calls == 2);
+    REQUIRE(string(reported[1].name) == "Where");
+    REQUIRE(reported[1].elements_in == 10);
+    REQUIRE(reported[1].elements_out == 2);
+  }
+
+  SECTION("Transform().Transform() of a reference into a temporary") {
+    struct Big {
+      string s;
+    };
+    vector<int> in = {0, 1};
+    vector<string> out =
+        raman::From(in)
+            .Transform([](int i) { return Big{string(100, 'a' + i)}; })
+            .Transform([](const Big& b) -> const string& { return b.s; });
+    REQUIRE(out == (vector<string>{string(100, 'a'), string(100, 'b')}));
+  }
+
+  SECTION("Transform() after Values()") {
+    map<int, string> m = {{1, "one"}, {2, "two"}};
+    vector<std::size_t> sizes =
+        raman::From(m).Values().Transform([](const string& s) {
+          return s.size();
+        });
+    REQUIRE(sizes == vector<std::size_t>{3, 3});
+  }
+
+  SECTION("AddressOf().Dereference() is dropped") {
+    vector<int> in = {1, 2, 3};
+    using Source = decltype(raman::From(in));
+    static_assert(
+        std::is_same<decltype(raman::From(in).AddressOf().Dereference()),
+                     Source>::value, "");
+    for (int& i : raman::From(in).AddressOf().Dereference()) {
+      i *= 2;
+    }
+    REQUIRE(in == vector<int>{2, 4, 6});
+  }
+
+  SECTION("Dereference().AddressOf() of raw pointers is dropped") {
+    int a = 1, b = 2;
+    vector<int*> in = {&a, &b};
+    using Source = decltype(raman::From(in));
+    static_assert(
+        std::is_same<decltype(raman::From(in).Dereference().AddressOf()),
+                     Source>::value, "");
+    vector<int*> out = raman::From(in).Dereference().AddressOf();
+    REQUIRE(out == in);
+  }
+
+  SECTION("Reverse().Reverse() is dropped") {
+    list<int> in = {1, 2, 3};
+    using Source = decltype(raman::From(in));
+    static_assert(std::is_same<decltype(raman::From(in).Reverse().Reverse()),
+                               Source>::value, "");
+  }
+
+  SECTION("Sort().Reverse() sorts in descending order") {
+    vector<int> in = {3, 1, 4, 1, 5};
+    int comparisons = 0;
+    auto less = [&comparisons](int a, int b) {
+      ++comparisons;
+      return a < b;
+    };
+    auto sorted = raman::From(in).Sort(less);
+    // Nothing happens until the range is iterated.
+    REQUIRE(comparisons == 0);
+    vector<int> out = std::move(sorted).Reverse();
+    REQUIRE(out == vector<int>{5, 4, 3, 1, 1});
+    REQUIRE(comparisons > 0);
+
+    // The elements are still those of `in`.
+    for (int& i : raman::From(in).Sort().Reverse()) {
+      i = -i;
+    }
+    REQUIRE(in == vector<int>{-3, -1, -4, -1, -5});
+
+    vector<int> twice = raman::From(in).Sort().Reverse().Reverse();
+    REQUIRE(twice == vector<int>{-5, -4, -3, -1, -1});
+  }
+
+  SECTION("buffered Reverse() of single-pass ranges") {
+    istringstream stream("1 2 3");
+    vector<int> out = raman::From(istream_iterator<int>(stream),
+                                  istream_iterator<int>())
+                        .Reverse()
+                        .Where([](int i) { return i != 2; });
+    REQUIRE(out == vector<int>{3, 1});
+
+    forward_list<int> in = {1, 2, 3};
+    vector<int> twice = raman::From(in).Reverse().Reverse();
+    REQUIRE(twice == vector<int>{1, 2, 3});
+  }
+}
+
+TEST_CASE("stateless functors take no space") {
+  vector<int> in = {1, 2, 3, 4};
+  const std::size_t source = sizeof(raman::From(in));
+  // The statistics counter of each Where() or Transform(), if enabled.
+  const std::size_t counter = sizeof(raman::From(in).Probe("")) - source;
+  auto is_even = [](int i) { return i % 2 == 0; };
+  auto is_small = [](int i) { return i < 3; };
+  auto twice = [](int i) { return i * 2; };
+
+  REQUIRE(sizeof(raman::From(in).Where(is_even)) == source + counter);
+  REQUIRE(sizeof(raman::From(in).Transform(twice)) == source + counter);
+  REQUIRE(sizeof(raman::From(in).Where(is_even).Where(is_small)) ==
+          source + counter);
+  REQUIRE(sizeof(raman::From(in).Where(is_even).Transform(twice).Where(
+              is_small)) == source + 3 * counter);
+  REQUIRE(sizeof(raman::From(in).AddressOf()) == source + counter);
+  REQUIRE(sizeof(raman::From(in).Unique()) == source);
+  REQUIRE(sizeof(raman::From(in).Reverse()) == source);
+  auto greater = [](int a, int b) { return a > b; };
+  REQUIRE(sizeof(raman::From(in).Sort(std::greater<int>())) ==
+          sizeof(raman::From(in).Sort(greater)));
+
+  // Iterators hold their range's address and the underlying iterator.
+  auto filtered = raman::From(in).Where(is_even);
+  REQUIRE(sizeof(filtered.begin()) == sizeof(void*) + sizeof(in.begin()));
+  vector<int> out = std::move(filtered);
+  REQUIRE(out == vector<int>{2, 4});
+}
+
+TEST_CASE("Take & Skip") {
+  const vector<int> in = {1, 2, 3, 4, 5, 6, 7};
+  SECTION("random access") {
+    vector<int> page = raman::From(in).Skip(2).Take(3);
+    REQUIRE(page == vector<int>{3, 4, 5});
+    vector<int> short_page = raman::From(in).Skip(5).Take(3);
+    REQUIRE(short_page == vector<int>{6, 7});
+    vector<int> past_end = raman::From(in).Skip(10).Take(3);
+    REQUIRE(past_end.empty());
+    vector<int> nothing = raman::From(in).Take(0);
+    REQUIRE(nothing.empty());
+    vector<int> narrowed = raman::From(in).Take(5).Skip(1).Take(2).Skip(1);
+    REQUIRE(narrowed == vector<int>{3});
+    vector<int> sorted = raman::From(vector<int>{5, 1, 4, 2, 3})
+                           .Sort()
+                           .Skip(1)
+                           .Take(3)
+                           .Reverse();
+    REQUIRE(sorted == vector<int>{4, 3, 2});
+
+    // Slicing doesn't step over the skipped elements.
+    long long count = 0;
+    for (long long i : raman::Iota<long long>(0, 1LL << 60)
+                         .Skip(1LL << 59)
+                         .Take(2)) {
+      REQUIRE(i >= (1LL << 59));
+      ++count;
+    }
+    REQUIRE(count == 2);
+
+    vector<int> v = in;
+    for (int& i : raman::From(v).Skip(5)) {
+      i = 0;
+    }
+    REQUIRE(v == vector<int>{1, 2, 3, 4, 5, 0, 0});
+  }
+
+  SECTION("other ranges") {
+    auto is_odd = [](int i) { return i % 2 == 1; };
+    vector<int> odd = raman::From(in).Where(is_odd).Skip(1).Take(2);
+    REQUIRE(odd == vector<int>{3, 5});
+
+    list<int> l(in.begin(), in.end());
+    vector<int> last = raman::From(l).Skip(4).Reverse();
+    REQUIRE(last == vector<int>{7, 6, 5});
+    vector<int> first = raman::From(l).Take(10);
+    REQUIRE(first == in);
+    vector<int> none = raman::From(l).Skip(10);
+    REQUIRE(none.empty());
+  }
+
+  SECTION("single pass") {
+    istringstream stream("1 2 3 4 5");
+    vector<int> out = raman::From(istream_iterator<int>(stream),
+                                  istream_iterator<int>())
+                        .Skip(1)
+                        .Take(2);
+    REQUIRE(out == vector<int>{2, 3});
+    // Nothing past the last element taken was read.
+    int next = 0;
+    stream >> next;
+    REQUIRE(next == 4);
+
+    int calls = 0;
+    vector<int> generated = raman::Generate([&calls]() { return calls++; })
+                              .Take(3);
+    REQUIRE(generated == vector<int>{0, 1, 2});
+    REQUIRE(calls == 3);
+  }
+}
+
+TEST_CASE("TakeWhile & SkipWhile") {
+  const vector<int> in = {1, 2, 3, 4, 1, 2};
+  auto small = [](int i) { return i < 3; };
+
+  vector<int> head = raman::From(in).TakeWhile(small);
+  REQUIRE(head == vector<int>{1, 2});
+  vector<int> tail = raman::From(in).SkipWhile(small);
+  REQUIRE(tail == vector<int>{3, 4, 1, 2});
+  vector<int> all = raman::From(in).TakeWhile([](int) { return true; });
+  REQUIRE(all == in);
+  vector<int> none = raman::From(in).SkipWhile([](int) { return true; });
+  REQUIRE(none.empty());
+
+  list<int> l(in.begin(), in.end());
+  vector<int> reversed_tail = raman::From(l).SkipWhile(small).Reverse();
+  REQUIRE(reversed_tail == vector<int>{2, 1, 4, 3});
+
+  forward_list<int> fl(in.begin(), in.end());
+  vector<int> middle =
+      raman::From(fl).SkipWhile(small).TakeWhile([](int i) { return i > 2; });
+  REQUIRE(middle == vector<int>{3, 4});
+
+  // Moving a range which owns its elements doesn't keep an iterator into
+  // the moved-from ones.
+  auto owned = raman::From(array<int, 4>{1, 2, 3, 4}).SkipWhile(small);
+  REQUIRE(*owned.begin() == 3);
+  auto moved = std::move(owned);
+  REQUIRE(moved.end() - moved.begin() == 2);
+  decltype(moved) assigned = raman::From(array<int, 4>{3, 4, 5, 6})
+                               .SkipWhile(small);
+  REQUIRE(*assigned.begin() == 3);
+  assigned = std::move(moved);
+  REQUIRE(assigned.end() - assigned.begin() == 2);
+
+  int calls = 0;
+  vector<int> squares = raman::Generate([&calls]() {
+                          ++calls;
+                          return calls * calls;
+                        })
+                          .TakeWhile([](int i) { return i < 20; });
+  REQUIRE(squares == vector<int>{1, 4, 9, 16});
+  REQUIRE(calls == 5);
+}
+
+TEST_CASE("queries") {
+  // Longer than a block of the vectorized search.
+  vector<int> in = raman::Iota(0, 100);
+  auto negative = [](int i) { return i < 0; };
+  auto is_42 = [](int i) { return i == 42; };
+
+  REQUIRE(raman::From(in).Any());
+  REQUIRE_FALSE(raman::From(vector<int>{}).Any());
+  REQUIRE(raman::From(in).Any(is_42));
+  REQUIRE_FALSE(raman::From(in).Any(negative));
+  REQUIRE(raman::From(in).All([](int i) { return i < 100; }));
+  REQUIRE_FALSE(raman::From(in).All([](int i) { return i < 99; }));
+  REQUIRE(raman::From(in).None(negative));
+  REQUIRE_FALSE(raman::From(in).None(is_42));
+  REQUIRE(raman::From(in).Contains(99));
+  REQUIRE(raman::From(in).Contains(0));
+  REQUIRE_FALSE(raman::From(in).Contains(100));
+  REQUIRE(raman::From(vector<double>{0.5, 1.5}).Contains(1.5));
+  REQUIRE(raman::From(in.data(), in.data() + 20).Contains(19));
+
+  REQUIRE(raman::From(in).First() == 0);
+  REQUIRE(raman::From(in).First([](int i) { return i > 16; }) == 17);
+  REQUIRE(raman::From(in).Skip(30).First(
+              [](int i) { return i % 7 == 0; }) == 35);
+  REQUIRE(raman::From(in).FirstOrDefault(negative) == 0);
+  REQUIRE(raman::From(in).FirstOrDefault(negative, -1) == -1);
+  REQUIRE(raman::From(vector<int>{}).FirstOrDefault() == 0);
+  REQUIRE(raman::From(vector<int>{}).FirstOrDefault(7) == 7);
+  REQUIRE_THROWS(raman::From(in).First(negative));
+
+  int* found = raman::From(in).Find(is_42);
+  REQUIRE(found == &in[42]);
+  *found = -42;
+  REQUIRE(raman::From(in).Find(negative) == &in[42]);
+  REQUIRE(raman::From(in).Where(negative).Find(is_42) == nullptr);
+
+  SECTION("non-contiguous ranges") {
+    list<string> l = {"one", "two", "three"};
+    REQUIRE(raman::From(l).Contains("two"));
+    REQUIRE(raman::From(l).First([](const string& s) {
+      return s.size() > 3;
+    }) == "three");
+    REQUIRE(raman::From(l).Transform([](const string& s) {
+      return s.size();
+    }).All([](std::size_t size) { return size >= 3; }));
+  }
+
+  SECTION("stops at the first decisive element") {
+    int calls = 0;
+    REQUIRE(raman::From(list<int>{1, 2, 3, 4}).Any([&calls](int i) {
+      ++calls;
+      return i == 2;
+    }));
+    REQUIRE(calls == 2);
+
+    calls = 0;
+    REQUIRE(raman::Generate([&calls]() { return ++calls; }).Contains(5));
+    REQUIRE(calls == 5);
+
+    istringstream stream("1 2 3 4");
+    REQUIRE(raman::From(istream_iterator<int>(stream),
+                        istream_iterator<int>()).First() == 1);
+    int next = 0;
+    stream >> next;
+    REQUIRE(next == 2);
+  }
+}
+
+TEST_CASE("Merge") {
+  const vector<int> a = {1, 4, 7, 10};
+  const vector<int> b = {2, 5, 8};
+  const vector<int> c = {3, 6, 9, 11, 12};
+  const vector<int> empty;
+
+  vector<int> merged = raman::Merge(a, b, c);
+  vector<int> expected = raman::Iota(1, 13);
+  REQUIRE(merged == expected);
+  vector<int> with_empty = raman::Merge(empty, a, empty, b, empty);
+  REQUIRE(with_empty == vector<int>{1, 2, 4, 5, 7, 8, 10});
+  vector<int> single = raman::Merge(a);
+  REQUIRE(single == a);
+  vector<int> nothing = raman::Merge(empty, empty);
+  REQUIRE(nothing.empty());
+
+  vector<int> descending = raman::Merge(vector<int>{9, 5, 1},
+                                        vector<int>{8, 2},
+                                        std::greater<int>());
+  REQUIRE(descending == vector<int>{9, 8, 5, 2, 1});
+
+  vector<int> pipelines =
+      raman::Merge(raman::From(a).Take(2), raman::From(c).Take(2)).Where(
+          [](int i) { return i != 3; });
+  REQUIRE(pipelines == vector<int>{1, 4, 6});
+
+  SECTION("equal elements keep the order of their ranges") {
+    using Entry = std::pair<int, char>;
+    vector<Entry> x = {{1, 'x'}, {2, 'x'}};
+    vector<Entry> y = {{1, 'y'}, {2, 'y'}};
+    auto by_key = [](const Entry& l, const Entry& r) {
+      return l.first < r.first;
+    };
+    vector<Entry> out = raman::Merge(y, x, by_key);
+    REQUIRE(out == (vector<Entry>{{1, 'y'}, {1, 'x'}, {2, 'y'}, {2, 'x'}}));
+  }
+
+  SECTION("MergeAll") {
+    vector<vector<int>> shards;
+    for (int shard = 0; shard < 10; ++shard) {
+      shards.push_back(raman::Iota(0, 100)
+                           .Where([shard](int i) { return i % 10 == shard; }));
+    }
+    vector<int> all = raman::MergeAll(shards);
+    vector<int> expected_all = raman::Iota(0, 100);
+    REQUIRE(all == expected_all);
+
+    // Elements are those of the shards.
+    for (int& i : raman::MergeAll(shards).Take(5)) {
+      i = -1;
+    }
+    REQUIRE(shards[4][0] == -1);
+    REQUIRE(shards[5][0] == 5);
+
+    list<list<string>> words = {{"b", "d"}, {}, {"a", "c", "e"}};
+    vector<string> sorted_words = raman::MergeAll(words);
+    REQUIRE(sorted_words == vector<string>{"a", "b", "c", "d", "e"});
+  }
+}
+
+namespace {
+  // Checks set operations against their std:: counterparts.
+  template <typename Container>
+  void TestSetOperations(const vector<int>& a, const vector<int>& b) {
+    const Container left(a.begin(), a.end());
+    const Container right(b.begin(), b.end());
+    vector<int> expected;
+
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                          std::back_inserter(expected));
+    vector<int> intersection = raman::From(left).Intersect(right);
+    REQUIRE(intersection == expected);
+
+    expected.clear();
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                   std::back_inserter(expected));
+    vector<int> union_ = raman::From(left).Union(right);
+    REQUIRE(union_ == expected);
+
+    expected.clear();
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                        std::back_inserter(expected));
+    vector<int> difference = raman::From(left).Except(right);
+    REQUIRE(difference == expected);
+
+    expected.clear();
+    std::set_symmetric_difference(a.begin(), a.end(), b.begin(), b.end(),
+                                  std::back_inserter(expected));
+    vector<int> symmetric_difference =
+        raman::From(left).SymmetricDifference(right);
+    REQUIRE(symmetric_difference == expected);
+  }
+}
+
+TEST_CASE("set operations") {
+  const vector<int> a = {1, 2, 2, 2, 4, 6, 8, 9};
+  const vector<int> b = {2, 2, 3, 4, 9, 10};
+  TestSetOperations<vector<int>>(a, b);
+  TestSetOperations<vector<int>>(b, a);
+  TestSetOperations<list<int>>(a, b);
+  TestSetOperations<list<int>>(b, a);
+  TestSetOperations<vector<int>>(a, {});
+  TestSetOperations<vector<int>>({}, a);
+  TestSetOperations<list<int>>({}, {});
+
+  // Sizes which take galloping search through all its cases.
+  vector<int> large = raman::Iota(0, 1000);
+  for (int step : {1, 3, 64, 200, 999, 1000}) {
+    vector<int> small = raman::Iota(0, 1000 / step).Transform(
+        [step](int i) { return i * step + 1; });
+    TestSetOperations<vector<int>>(small, large);
+    TestSetOperations<vector<int>>(large, small);
+  }
+
+  SECTION("pipelines") {
+    vector<int> evens = raman::Iota(0, 20)
+                          .Where([](int i) { return i % 2 == 0; })
+                          .Intersect(raman::From(vector<int>{9, 6, 3, 12})
+                                       .Sort());
+    REQUIRE(evens == vector<int>{6, 12});
+
+    vector<int> descending =
+        raman::From(vector<int>{5, 3, 1})
+          .Union(vector<int>{4, 3, 2}, std::greater<int>());
+    REQUIRE(descending == vector<int>{5, 4, 3, 2, 1});
+
+    istringstream stream("1 2 3 4 5");
+    vector<int> streamed = raman::From(istream_iterator<int>(stream),
+                                       istream_iterator<int>())
+                             .Except(set<int>{2, 4});
+    REQUIRE(streamed == vector<int>{1, 3, 5});
+  }
+
+  SECTION("Intersect() and Except() refer to the left range") {
+    vector<int> ids = {1, 2, 3, 4};
+    for (int& id : raman::From(ids).Intersect(vector<int>{2, 4})) {
+      id = -id;
+    }
+    REQUIRE(ids == vector<int>{1, -2, 3, -4});
+  }
+}
+
+TEST_CASE("Zip & Enumerate") {
+  const vector<string> names = {"ann", "bob", "cid"};
+  vector<int> ages = {31, 25, 47, 99};
+
+  SECTION("Zip") {
+    vector<std::tuple<string, int>> zipped = raman::From(names).Zip(ages);
+    REQUIRE(zipped == (vector<std::tuple<string, int>>{
+                          {"ann", 31}, {"bob", 25}, {"cid", 47}}));
+
+    // Elements are referred to, not copied.
+    for (auto pair : raman::From(names).Zip(ages)) {
+      std::get<1>(pair) += 1;
+    }
+    REQUIRE(ages == vector<int>{32, 26, 48, 99});
+
+    list<int> weights = {60, 70};
+    vector<int> sums = raman::From(ages)
+                         .Zip(weights, raman::Iota(0, 100))
+                         .Transform([](auto t) {
+                           return std::get<0>(t) + std::get<1>(t) +
+                                  std::get<2>(t);
+                         });
+    REQUIRE(sums == vector<int>{92, 97});
+
+    vector<int> empty;
+    REQUIRE(!raman::From(names).Zip(empty).Any());
+  }
+
+  SECTION("random-access Zip") {
+    auto zip = raman::From(ages).Zip(names);
+    auto begin = zip.begin();
+    auto end = zip.end();
+    REQUIRE(end - begin == 3);
+    REQUIRE(std::get<1>(begin[2]) == "cid");
+    REQUIRE(std::get<0>(*(end - 1)) == 47);
+    REQUIRE(end > begin);
+    REQUIRE(begin <= end);
+    REQUIRE(end >= end);
+    REQUIRE(!(begin >= end));
+    REQUIRE(std::get<1>(*(2 + begin)) == "cid");
+
+    vector<string> page = raman::From(ages)
+                            .Zip(names)
+                            .Skip(1)
+                            .Take(1)
+                            .Transform([](auto t) { return std::get<1>(t); });
+    REQUIRE(page == vector<string>{"bob"});
+
+    auto name = [](auto t) { return std::get<0>(t); };
+    vector<string> reversed =
+        raman::From(names).Zip(ages).Reverse().Transform(name);
+    REQUIRE(reversed == vector<string>{"cid", "bob", "ann"});
+  }
+
+  SECTION("Sort copies zipped elements") {
+    vector<int> keys = {3, 1, 2};
+    vector<char> values = {'c', 'a', 'b'};
+    vector<std::tuple<int, char>> sorted =
+        raman::From(keys).Zip(values).Sort();
+    REQUIRE(sorted == (vector<std::tuple<int, char>>{
+                          {1, 'a'}, {2, 'b'}, {3, 'c'}}));
+    REQUIRE(keys == vector<int>{3, 1, 2});
+    REQUIRE(values == vector<char>{'c', 'a', 'b'});
+  }
+
+  SECTION("Enumerate") {
+    vector<std::pair<size_t, string>> enumerated =
+        raman::From(names).Enumerate();
+    REQUIRE(enumerated == (vector<std::pair<size_t, string>>{
+                              {0, "ann"}, {1, "bob"}, {2, "cid"}}));
+
+    vector<size_t> over_30 =
+        raman::From(ages)
+          .Enumerate()
+          .Where([](auto p) { return p.second > 30; })
+          .Transform([](auto p) { return p.first; });
+    REQUIRE(over_30 == vector<size_t>{0, 2, 3});
+
+    for (auto p : raman::From(ages).Enumerate()) {
+      p.second = static_cast<int>(p.first);
+    }
+    REQUIRE(ages == vector<int>{0, 1, 2, 3});
+
+    auto enumerate = raman::From(names).Enumerate();
+    REQUIRE((*(enumerate.end() - 1)).first == 2);
+    REQUIRE(enumerate.end() > enumerate.begin());
+    REQUIRE(enumerate.begin() <= enumerate.end());
+    REQUIRE(enumerate.end() >= enumerate.end());
+    REQUIRE(!(enumerate.begin() > enumerate.end()));
+    REQUIRE((*(1 + enumerate.begin())).second == "bob");
+    vector<size_t> backwards = raman::From(names)
+                                 .Enumerate()
+                                 .Reverse()
+                                 .Transform([](auto p) { return p.first; });
+    REQUIRE(backwards == vector<size_t>{2, 1, 0});
+
+    list<string> linked(names.begin(), names.end());
+    vector<size_t> indices = raman::From(linked).Enumerate().Transform(
+        [](auto p) { return p.first; });
+    REQUIRE(indices == vector<size_t>{0, 1, 2});
+  }
+}
+
+TEST_CASE("Concat & FlatMap") {
+  SECTION("Concat") {
+    vector<int> a = {1, 2};
+    list<int> b = {3};
+    const vector<int> empty;
+    vector<int> all = raman::From(a).Concat(empty, b, empty, vector<int>{4});
+    REQUIRE(all == vector<int>{1, 2, 3, 4});
+    vector<int> reversed = raman::Concat(empty, a, b, empty).Reverse();
+    REQUIRE(reversed == vector<int>{3, 2, 1});
+    vector<int> nothing = raman::Concat(empty, empty);
+    REQUIRE(nothing.empty());
+
+    for (int& i : raman::From(a).Concat(b)) {
+      i *= 10;
+    }
+    REQUIRE(a == vector<int>{10, 20});
+    REQUIRE(b == list<int>{30});
+
+    // Ranges of different reference types are concatenated by value.
+    vector<long> mixed = raman::From(a).Concat(
+        raman::Iota(0, 2).Transform([](int i) { return i * 1.5; }));
+    REQUIRE(mixed == vector<long>{10, 20, 0, 1});
+
+    istringstream stream("5 6");
+    vector<int> streamed = raman::From(istream_iterator<int>(stream),
+                                       istream_iterator<int>())
+                             .Concat(a);
+    REQUIRE(streamed == vector<int>{5, 6, 10, 20});
+  }
+
+  SECTION("FlatMap by reference") {
+    vector<vector<int>> nested = {{}, {1, 2}, {}, {}, {3}, {}};
+    vector<int> flat = raman::From(nested).Flatten();
+    REQUIRE(flat == vector<int>{1, 2, 3});
+    vector<int> reversed = raman::From(nested).Flatten().Reverse();
+    REQUIRE(reversed == vector<int>{3, 2, 1});
+    vector<vector<int>> empties(3);
+    REQUIRE(!raman::From(empties).Flatten().Any());
+
+    map<string, vector<int>> groups = {{"a", {1}}, {"b", {}}, {"c", {2, 3}}};
+    vector<int> values = raman::From(groups).Values().Flatten();
+    REQUIRE(values == vector<int>{1, 2, 3});
+    for (int& i : raman::From(groups).FlatMap(
+             [](auto& entry) -> auto& { return entry.second; })) {
+      i = -i;
+    }
+    REQUIRE(groups["c"] == vector<int>{-2, -3});
+
+    auto flattened = raman::From(nested).Flatten();
+    auto it = flattened.end();
+    REQUIRE(*--it == 3);
+    REQUIRE(*--it == 2);
+    REQUIRE(*++it == 3);
+    REQUIRE(++it == flattened.end());
+  }
+
+  SECTION("FlatMap by value") {
+    vector<int> counts = {2, 0, 3};
+    vector<int> ranges = raman::From(counts).FlatMap(
+        [](int count) { return raman::Iota(0, count); });
+    REQUIRE(ranges == vector<int>{0, 1, 0, 1, 2});
+
+    vector<string> words = {"ab", "", "c"};
+    string letters = raman::From(words).FlatMap(
+        [](const string& word) { return string(word); });
+    REQUIRE(letters == "abc");
+
+    vector<int> evens = raman::Iota(0, 4).Transform([](int i) {
+      return vector<int>(static_cast<size_t>(i), i);
+    }).Flatten().Where([](int i) { return i % 2 == 0; });
+    REQUIRE(evens == vector<int>{2, 2});
+  }
+}
+
+TEST_CASE("Window & Adjacent") {
+  const vector<int> samples = {1, 4, 9, 16, 25};
+  auto sum = [](auto window) {
+    int sum = 0;
+    for (int i : window) sum += i;
+    return sum;
+  };
+
+  SECTION("Window") {
+    vector<int> sums = raman::From(samples).Window(3).Transform(sum);
+    REQUIRE(sums == vector<int>{14, 29, 50});
+    vector<int> singles = raman::From(samples).Window(1).Transform(sum);
+    REQUIRE(singles == samples);
+    REQUIRE(!raman::From(samples).Window(6).Any());
+    vector<int> whole = raman::From(samples).Window(5).Transform(sum);
+    REQUIRE(whole == vector<int>{55});
+
+    auto windows = raman::From(samples).Window(2);
+    REQUIRE(windows.end() - windows.begin() == 4);
+    auto last = *(windows.end() - 1);
+    REQUIRE(last.size() == 2);
+    REQUIRE(last.front() == 16);
+    REQUIRE(last.back() == 25);
+    REQUIRE(last[1] == 25);
+    auto span = [](auto window) { return window.back() - window.front(); };
+    vector<int> spans =
+        raman::From(samples).Window(2).Reverse().Skip(1).Transform(span);
+    REQUIRE(spans == vector<int>{7, 5, 3});
+
+    forward_list<int> linked(samples.begin(), samples.end());
+    vector<int> linked_sums = raman::From(linked).Window(4).Transform(sum);
+    REQUIRE(linked_sums == vector<int>{30, 54});
+
+    // Windows refer to the range.
+    vector<int> values = {1, 2, 3};
+    for (auto window : raman::From(values).Window(2)) {
+      *window.begin() = 0;
+    }
+    REQUIRE(values == vector<int>{0, 0, 3});
+  }
+
+  SECTION("Adjacent") {
+    auto delta = [](auto pair) {
+      return std::get<1>(pair) - std::get<0>(pair);
+    };
+    vector<int> deltas = raman::From(samples).Pairwise().Transform(delta);
+    REQUIRE(deltas == vector<int>{3, 5, 7, 9});
+
+    list<int> linked(samples.begin(), samples.end());
+    vector<int> linked_deltas =
+        raman::From(linked).Pairwise().Transform(delta);
+    REQUIRE(linked_deltas == deltas);
+
+    vector<std::tuple<int, int, int>> triples =
+        raman::From(linked).Adjacent<3>();
+    REQUIRE(triples == (vector<std::tuple<int, int, int>>{
+                           {1, 4, 9}, {4, 9, 16}, {9, 16, 25}}));
+
+    vector<int> reversed = raman::From(samples)
+                             .Pairwise()
+                             .Transform(delta)
+                             .Reverse();
+    REQUIRE(reversed == vector<int>{9, 7, 5, 3});
+    auto pairs = raman::From(samples).Pairwise();
+    REQUIRE(pairs.end() - pairs.begin() == 4);
+    REQUIRE(std::get<0>(pairs.begin()[3]) == 16);
+
+    REQUIRE(!raman::From(vector<int>{1}).Pairwise().Any());
+    REQUIRE(!raman::From(list<int>{}).Pairwise().Any());
+
+    auto odd = [](int i) { return i % 2 == 1; };
+    vector<int> odd_deltas = raman::From(samples)
+                               .Where(odd)
+                               .Pairwise()
+                               .Transform(delta);
+    REQUIRE(odd_deltas == vector<int>{8, 16});
+  }
+
+  SECTION("no allocations") {
+    vector<int> values = raman::Iota(0, 100);
+    size_t allocations = allocation_count;
+    int total = 0;
+    for (auto window : raman::From(values).Window(10)) {
+      total += window.front();
+    }
+    for (auto pair : raman::From(values).Adjacent<4>()) {
+      total += std::get<3>(pair);
+    }
+    REQUIRE(allocation_count == allocations);
+    REQUIRE(total == 4095 + 4947);
+  }
+}
+
+TEST_CASE("Partition") {
+  const vector<int> in = {5, 2, 8, 1, 4, 7};
+  auto is_even = [](int i) { return i % 2 == 0; };
+
+  SECTION("Partition") {
+    int calls = 0;
+    auto partition = raman::From(in).Partition([&](int i) {
+      ++calls;
+      return i % 2 == 0;
+    });
+    REQUIRE(partition.first == vector<int>{2, 8, 4});
+    REQUIRE(partition.second == vector<int>{5, 1, 7});
+    REQUIRE(calls == 6);
+
+    auto sets = raman::From(in).Partition<set<int>>(is_even);
+    REQUIRE(sets.first == set<int>{2, 4, 8});
+    REQUIRE(sets.second == set<int>{1, 5, 7});
+
+    istringstream stream("1 2 3");
+    auto streamed = raman::From(istream_iterator<int>(stream),
+                                istream_iterator<int>())
+                      .Partition(is_even);
+    REQUIRE(streamed.first == vector<int>{2});
+    REQUIRE(streamed.second == vector<int>{1, 3});
+
+    vector<int> evens = {0};
+    list<int> odds;
+    raman::From(in).Partition(is_even, evens, odds);
+    REQUIRE(evens == vector<int>{0, 2, 8, 4});
+    REQUIRE(odds == list<int>{5, 1, 7});
+
+    // Containers with room reserved don't reallocate.
+    vector<int> accepted, rejected;
+    accepted.reserve(in.size());
+    rejected.reserve(in.size());
+    const int* data = accepted.data();
+    raman::From(in).Partition(is_even, accepted, rejected);
+    REQUIRE(accepted.data() == data);
+    REQUIRE(accepted == vector<int>{2, 8, 4});
+  }
+
+  SECTION("PartitionInto") {
+    auto buckets = raman::From(in).PartitionInto(
+        3, [](int i) { return i % 3; });
+    REQUIRE(buckets.size() == 3);
+    REQUIRE(buckets[0].empty());
+    REQUIRE(buckets[1] == vector<int>{1, 4, 7});
+    REQUIRE(buckets[2] == vector<int>{5, 2, 8});
+
+    auto lists = raman::From(in).PartitionInto<list<int>>(
+        2, [](int i) { return i > 4; });
+    REQUIRE(lists == (vector<list<int>>{{2, 1, 4}, {5, 8, 7}}));
+
+    array<vector<int>, 2> halves;
+    for (auto& half : halves) {
+      half.reserve(in.size());
+    }
+    size_t allocations = allocation_count;
+    raman::From(in).PartitionInto(halves, is_even);
+    REQUIRE(allocation_count == allocations);
+    REQUIRE(halves[0] == vector<int>{5, 1, 7});
+    REQUIRE(halves[1] == vector<int>{2, 8, 4});
+
+    REQUIRE_THROWS(raman::From(in).PartitionInto(
+        2, [](int i) { return i; }));
+  }
+}
+
+namespace {
+  // A custom accumulator for Aggregate().
+  struct Concatenation {
+    void Add(const string& word) { result += word; }
+    string Result() const { return result; }
+
+    string result;
+  };
+}
+
+TEST_CASE("Aggregate & Tee") {
+  const vector<int> in = {7, -2, 9, 4, -5, 12};
+  auto is_positive = [](int i) { return i > 0; };
+
+  SECTION("Aggregate") {
+    int calls = 0;
+    auto stats = raman::From(in)
+                   .Where([&](int i) {
+                     ++calls;
+                     return i > 0;
+                   })
+                   .Aggregate(raman::Count(), raman::Sum(), raman::Min(),
+                              raman::Max(), raman::Sum<double>());
+    REQUIRE(calls == 6);
+    REQUIRE(std::get<0>(stats) == 4);
+    REQUIRE(std::get<1>(stats) == 32);
+    REQUIRE(std::get<2>(stats) == 4);
+    REQUIRE(std::get<3>(stats) == 12);
+    REQUIRE(std::get<4>(stats) == 32.0);
+
+    auto histogram = raman::From(in).Where(is_positive).Aggregate(
+        raman::Histogram(3, [](int i) { return i / 5; }));
+    REQUIRE(std::get<0>(histogram) == vector<size_t>{1, 2, 1});
+
+    auto empty = raman::From(vector<int>{}).Aggregate(
+        raman::Count(), raman::Min(), raman::Max());
+    REQUIRE(empty == std::make_tuple(size_t{0}, 0, 0));
+
+    const vector<string> words = {"b", "ccc", "a", "dd"};
+    auto by_length = [](const string& a, const string& b) {
+      return a.size() < b.size();
+    };
+    auto text = raman::From(words).Aggregate(
+        raman::Min(), raman::Max(), raman::Max(by_length), Concatenation());
+    REQUIRE(text == std::make_tuple(string("a"), string("dd"),
+                                    string("ccc"), string("bcccadd")));
+
+    istringstream stream("1 2 3");
+    auto streamed = raman::From(istream_iterator<int>(stream),
+                                istream_iterator<int>())
+                      .Aggregate(raman::Sum<long long>());
+    REQUIRE(std::get<0>(streamed) == 6LL);
+  }
+
+  SECTION("Tee") {
+    int sum = 0;
+    vector<int> copy;
+    raman::From(in).Where(is_positive).Tee(
+        [&](int i) { sum += i; }, [&](int i) { copy.push_back(i); });
+    REQUIRE(sum == 32);
+    REQUIRE(copy == vector<int>{7, 9, 4, 12});
+  }
+}
+
+TEST_CASE("TumblingWindow & SlidingWindow") {
+  struct Event {
+    int time;
+    int latency;
+  };
+  const vector<Event> events = {{0, 5}, {3, 9}, {4, 1},
+                                {10, 7}, {31, 2}, {33, 8}};
+  auto time = [](const Event& event) { return event.time; };
+  auto latency = [](const Event& event) { return event.latency; };
+  using Window = std::pair<int, std::tuple<size_t, int>>;
+
+  SECTION("TumblingWindow") {
+    vector<Window> windows = raman::From(events).TumblingWindow(
+        time, 10, raman::Count(), raman::Of(latency, raman::Max()));
+    REQUIRE(windows == (vector<Window>{{0, std::make_tuple(3, 9)},
+                                       {10, std::make_tuple(1, 7)},
+                                       {30, std::make_tuple(2, 8)}}));
+
+    auto identity = [](int i) { return i; };
+    vector<std::pair<int, std::tuple<size_t>>> negative =
+        raman::From(vector<int>{-7, -2, -1, 1})
+          .TumblingWindow(identity, 5, raman::Count());
+    REQUIRE(negative == (vector<std::pair<int, std::tuple<size_t>>>{
+                            {-10, std::make_tuple(1)},
+                            {-5, std::make_tuple(2)},
+                            {0, std::make_tuple(1)}}));
+
+    istringstream stream("100 101 250 999");
+    vector<std::pair<int, std::tuple<int>>> streamed =
+        raman::From(istream_iterator<int>(stream), istream_iterator<int>())
+          .Where([](int i) { return i < 500; })
+          .TumblingWindow(identity, 100, raman::Sum());
+    REQUIRE(streamed == (vector<std::pair<int, std::tuple<int>>>{
+                            {100, std::make_tuple(201)},
+                            {200, std::make_tuple(250)}}));
+
+    REQUIRE(!raman::From(vector<int>{})
+               .TumblingWindow(identity, 10, raman::Count())
+               .Any());
+    // Keys must not decrease.
+    REQUIRE_THROWS(raman::From(vector<int>{15, 1})
+                     .TumblingWindow(identity, 10, raman::Count())
+                     .Any());
+  }
+
+  SECTION("SlidingWindow") {
+    vector<Window> windows = raman::From(events).SlidingWindow(
+        time, 10, 5, raman::Count(), raman::Of(latency, raman::Max()));
+    REQUIRE(windows == (vector<Window>{{-5, std::make_tuple(3, 9)},
+                                       {0, std::make_tuple(3, 9)},
+                                       {5, std::make_tuple(1, 7)},
+                                       {10, std::make_tuple(1, 7)},
+                                       {25, std::make_tuple(2, 8)},
+                                       {30, std::make_tuple(2, 8)}}));
+
+    // Each window merges its panes' histograms.
+    auto histograms = raman::From(events).SlidingWindow(
+        time, 15, 5, raman::Of(latency, raman::Histogram(
+            2, [](int latency) { return latency > 5 ? 1 : 0; })));
+    auto it = histograms.begin();
+    REQUIRE((*it).first == -10);
+    REQUIRE(std::get<0>((*it).second) == vector<size_t>{2, 1});
+    ++it;
+    ++it;
+    REQUIRE((*it).first == 0);
+    REQUIRE(std::get<0>((*it).second) == vector<size_t>{2, 2});
+  }
+}
+
+TEST_CASE("WriteTo") {
+  SECTION("Numbers as std::ostream writes them") {
+    vector<int> input = {0, 7, -12, 2147483647, -2147483647 - 1};
+    std::ostringstream expected, actual;
+    for (int i : input) expected << i << "\n";
+    raman::From(input).WriteTo(actual);
+    REQUIRE(actual.str() == expected.str());
+
+    std::ostringstream unsigned_output;
+    raman::From(vector<unsigned long long>{0, 18446744073709551615ull})
+        .WriteTo(unsigned_output, ",");
+    REQUIRE(unsigned_output.str() == "0,18446744073709551615,");
+
+    std::ostringstream float_output;
+    raman::From(vector<double>{0.5, -2.25, 3, 1e100}).WriteTo(float_output,
+                                                            " ");
+    REQUIRE(float_output.str() == "0.5 -2.25 3 1e+100 ");
+  }
+
+  SECTION("Doubles parse back") {
+    vector<double> input = {0.1, 1.0 / 3, -123456.789e-30};
+    std::ostringstream output;
+    raman::From(input).WriteTo(output);
+    std::istringstream stream(output.str());
+    std::istream_iterator<double> begin(stream), end;
+    REQUIRE(vector<double>(begin, end) == input);
+  }
+
+  SECTION("Chars, bools and strings") {
+    std::ostringstream output;
+    raman::From(vector<char>{'a', 'b'}).WriteTo(output, "");
+    raman::From(vector<bool>{true, false}).WriteTo(output, "");
+    raman::From(vector<string>{"xy", ""}).WriteTo(output, "|");
+    raman::From(vector<const char*>{"c"}).WriteTo(output, "|");
+    REQUIRE(output.str() == "ab10xy||c|");
+  }
+
+  SECTION("Callable sink, in large blocks") {
+    string output;
+    int writes = 0;
+    auto sink = [&](const char* data, std::size_t size) {
+      output.append(data, size);
+      ++writes;
+    };
+    raman::Iota(0, 100000).WriteTo(sink);
+    std::ostringstream expected;
+    for (int i = 0; i < 100000; ++i) expected << i << "\n";
+    REQUIRE(output == expected.str());
+    REQUIRE(writes < 10);
+
+    // Elements larger than the buffer are written as they are.
+    output.clear();
+    raman::From(vector<string>{string(100000, 'x'), "y"}).WriteTo(sink, "");
+    REQUIRE(output == string(100000, 'x') + "y");
+
+    output.clear();
+    raman::From(vector<int>{}).WriteTo(sink);
+    REQUIRE(output.empty());
+  }
+}
+
+#ifdef RAMAN_HAS_CHARCONV
+namespace {
+  // Whether FromCsv() accepts text of type Text.
+  template <typename Text, typename = void>
+  struct CanParseCsv : std::false_type {};
+  template <typename Text>
+  struct CanParseCsv<
+      Text, std::void_t<decltype(raman::FromCsv<int>(std::declval<Text>()))>>
+      : std::true_type {};
+}  // namespace
+
+TEST_CASE("FromCsv") {
+  using std::string_view;
+  using std::tuple;
+
+  SECTION("Typed fields") {
+    string text = "1,ab,2.5,x\n-20,,0.125,y\n";
+    vector<tuple<int, string_view, double, char>> rows =
+        raman::FromCsv<int, string_view, double, char>(text);
+    REQUIRE(rows == (vector<tuple<int, string_view, double, char>>{
+                        {1, "ab", 2.5, 'x'}, {-20, "", 0.125, 'y'}}));
+    // Views into the text, rather than copies.
+    REQUIRE(std::get<1>(rows[0]).data() == text.data() + 2);
+
+    // The last line needs no line break, and may end with "\r\n".
+    string crlf_text = "1,2\r\n3,4";
+    vector<tuple<int, int>> pairs = raman::FromCsv<int, int>(crlf_text);
+    REQUIRE(pairs == (vector<tuple<int, int>>{{1, 2}, {3, 4}}));
+  }
+
+  SECTION("Quotes") {
+    string text = "\"a,\"\"b\"\"\",\"7\"\n\"two\nlines\",8\n";
+    vector<tuple<string, int>> rows = raman::FromCsv<string, int>(text);
+    REQUIRE(rows == (vector<tuple<string, int>>{{"a,\"b\"", 7},
+                                                {"two\nlines", 8}}));
+    // Views keep the escaped quotes of the text.
+    vector<tuple<string_view, int>> views =
+        raman::FromCsv<string_view, int>(text);
+    REQUIRE(std::get<0>(views[0]) == "a,\"\"b\"\"");
+
+    string escaped = "\"a\"\"b\",1\n\"\"\"\"\"\",2\n";
+    vector<tuple<string, int>> unescaped =
+        raman::FromCsv<string, int>(escaped);
+    REQUIRE(unescaped == (vector<tuple<string, int>>{{"a\"b", 1},
+                                                     {"\"\"", 2}}));
+  }
+
+  SECTION("Rows which don't parse are skipped") {
+    string text = "1,2\n\n3\n4,5,6\nx,7\n 8,9\n99999999999,1\n10,11";
+    vector<tuple<int, int>> rows = raman::FromCsv<int, int>(text);
+    REQUIRE(rows == (vector<tuple<int, int>>{{1, 2}, {10, 11}}));
+    string empty;
+    REQUIRE(!raman::FromCsv<int>(empty).Any());
+  }
+
+  SECTION("Temporary text") {
+    static_assert(CanParseCsv<string&>::value, "");
+    static_assert(CanParseCsv<const string&>::value, "");
+    static_assert(CanParseCsv<string_view>::value, "");
+    // Rows would refer to a destroyed string.
+    static_assert(!CanParseCsv<string>::value, "");
+    static_assert(!CanParseCsv<const string>::value, "");
+    string text = "1\n2\n";
+    vector<tuple<int>> rows = raman::FromCsv<int>(string_view(text));
+    REQUIRE(rows == (vector<tuple<int>>{{1}, {2}}));
+  }
+
+  SECTION("Options, and stages on rows") {
+    string text = "id\tname\n3\tc\n1\ta\n2\tb\n";
+    raman::CsvOptions options;
+    options.separator = '\t';
+    options.has_header = true;
+    vector<string_view> names =
+        raman::FromCsv<int, string_view>(text, options)
+            .Where([](const tuple<int, string_view>& row) {
+              return std::get<0>(row) > 1;
+            })
+            .Sort()
+            .Transform([](const tuple<int, string_view>& row) {
+              return std::get<1>(row);
+            });
+    REQUIRE(names == (vector<string_view>{"b", "c"}));
+  }
+}
+#endif
+
+TEST_CASE("WhereBatch") {
+  // Accepts even elements, a block at a time.
+  int calls = 0;
+  auto evens = [&calls](auto begin, auto end) {
+    ++calls;
+    std::uint64_t mask = 0;
+    int bit = 0;
+    for (auto it = begin; it != end; ++it, ++bit) {
+      if (*it % 2 == 0) mask |= std::uint64_t(1) << bit;
+    }
+    return mask;
+  };
+  vector<int> expected;
+  for (int i = 0; i < 200; i += 2) expected.push_back(i);
+
+  SECTION("Random access") {
+    vector<int> input = raman::Iota(0, 200);
+    vector<int> output = raman::From(input).WhereBatch(evens);
+    REQUIRE(output == expected);
+    // 64 + 64 + 64 + 8 elements.
+    REQUIRE(calls == 4);
+    // Elements are yielded in place.
+    REQUIRE(&*raman::From(input).WhereBatch(evens).begin() == &input[0]);
+  }
+
+  SECTION("Forward") {
+    std::forward_list<int> input(raman::Iota(0, 200).begin(),
+                                 raman::Iota(0, 200).end());
+    vector<int> output = raman::From(input).WhereBatch(evens);
+    REQUIRE(output == expected);
+    REQUIRE(calls == 4);
+  }
+
+  SECTION("Single pass") {
+    std::stringstream stream;
+    for (int i = 0; i < 200; ++i) stream << i << " ";
+    std::istream_iterator<int> begin(stream), end;
+    vector<int> output = raman::From(begin, end).WhereBatch(evens);
+    REQUIRE(output == expected);
+    REQUIRE(calls == 4);
+  }
+
+  SECTION("Sparse and empty masks") {
+    vector<int> input = raman::Iota(0, 1000);
+    // Only the last element of each block, and bits past the end ignored.
+    auto last = [](auto begin, auto end) {
+      return std::uint64_t(1) << (std::distance(begin, end) - 1) |
+             (std::uint64_t(1) << 63);
+    };
+    vector<int> output = raman::From(input).WhereBatch(last);
+    vector<int> lasts = raman::Iota(0, 15).Transform([](int i) {
+      return i * 64 + 63;
+    });
+    lasts.push_back(999);
+    REQUIRE(output == lasts);
+    vector<int> none = raman::From(input).WhereBatch(
+        [](auto, auto) { return std::uint64_t(0); });
+    REQUIRE(none.empty());
+    REQUIRE(!raman::From(vector<int>{}).WhereBatch(evens).Any());
+    REQUIRE(calls == 0);
+  }
+}
+
+TEST_CASE("Scan & InclusiveScan") {
+  vector<int> sizes = {3, 1, 4, 1, 5};
+
+  SECTION("Scan") {
+    vector<std::size_t> offsets = raman::From(sizes).Scan(std::size_t(0));
+    REQUIRE(offsets == (vector<std::size_t>{0, 3, 4, 8, 9}));
+    vector<int> products = raman::From(sizes).Scan(1, std::multiplies<>());
+    REQUIRE(products == (vector<int>{1, 3, 3, 12, 12}));
+    REQUIRE(!raman::From(vector<int>{}).Scan(0).Any());
+    // Results may be of another type than the elements.
+    vector<string> words = {"ab", "c"};
+    vector<string> prefixes = raman::From(words).Scan(string("-"));
+    REQUIRE(prefixes == (vector<string>{"-", "-ab"}));
+  }
+
+  SECTION("InclusiveScan") {
+    vector<int> totals = raman::From(sizes).InclusiveScan();
+    REQUIRE(totals == (vector<int>{3, 4, 8, 9, 14}));
+    vector<int> maxima = raman::From(sizes).InclusiveScan(
+        [](int a, int b) { return std::max(a, b); });
+    REQUIRE(maxima == (vector<int>{3, 3, 4, 4, 5}));
+    REQUIRE(!raman::From(vector<int>{}).InclusiveScan().Any());
+  }
+
+  SECTION("Lazy, on any range") {
+    std::forward_list<int> list(sizes.begin(), sizes.end());
+    auto scan = raman::From(list).InclusiveScan();
+    // Forward iterators may be copied and walked again.
+    auto it = scan.begin();
+    auto copy = it;
+    ++it;
+    REQUIRE(*copy == 3);
+    REQUIRE(*it == 4);
+    REQUIRE(*++copy == 4);
+
+    std::istringstream stream("1 2 3");
+    std::istream_iterator<int> begin(stream), end;
+    vector<int> totals =
+        raman::From(begin, end).InclusiveScan().Take(2);
+    REQUIRE(totals == (vector<int>{1, 3}));
+  }
+
+  SECTION("ParallelScan") {
+    vector<long> input = raman::Iota(0L, 1000000L).Transform([](long i) {
+      return i % 7;
+    });
+    vector<long> expected = raman::From(input).Scan(10L);
+    for (std::size_t threads : {1, 2, 3, 8}) {
+      REQUIRE(raman::From(input).ParallelScan(10L, std::plus<>(), threads) ==
+              expected);
+    }
+    REQUIRE(raman::From(input).ParallelScan(10L) == expected);
+    REQUIRE(raman::From(vector<long>{}).ParallelScan(0L).empty());
+
+    // Exceptions are passed on.
+    REQUIRE_THROWS(raman::From(input).ParallelScan(
+        0L, [](long a, long b) -> long {
+          if (b == 6) throw std::runtime_error("6");
+          return a + b;
+        }, 4));
+  }
+}
+
+TEST_CASE("Sample & SampleBy") {
+  std::mt19937 rng(42);
+
+  SECTION("Fewer elements than k") {
+    vector<int> input = {1, 2, 3};
+    REQUIRE(raman::From(input).Sample(5, rng) == input);
+    REQUIRE(raman::From(input).Sample(0, rng).empty());
+    REQUIRE(raman::From(vector<int>{}).Sample(5, rng).empty());
+  }
+
+  SECTION("Distinct elements of the input") {
+    vector<int> input = raman::Iota(0, 10000);
+    std::list<int> list(input.begin(), input.end());
+    for (vector<int> sample : {raman::From(input).Sample(100, rng),
+                               raman::From(list).Sample(100, rng)}) {
+      REQUIRE(sample.size() == 100);
+      std::sort(sample.begin(), sample.end());
+      REQUIRE(std::unique(sample.begin(), sample.end()) == sample.end());
+      REQUIRE(sample.front() >= 0);
+      REQUIRE(sample.back() < 10000);
+    }
+  }
+
+  SECTION("Uniform") {
+    // Each of 100 elements is kept by about 10% of samples of 10.
+    vector<int> counts(100);
+    vector<int> input = raman::Iota(0, 100);
+    std::forward_list<int> list(input.begin(), input.end());
+    for (int i = 0; i < 2000; ++i) {
+      for (int j : raman::From(input).Sample(10, rng)) ++counts[j];
+      for (int j : raman::From(list).Sample(10, rng)) ++counts[j];
+    }
+    for (int count : counts) {
+      REQUIRE(count > 300);
+      REQUIRE(count < 500);
+    }
+  }
+
+  SECTION("Random access ranges are jumped over") {
+    // Far too many elements to walk through.
+    vector<long long> sample = raman::Iota(0LL, 1LL << 50).Sample(10, rng);
+    REQUIRE(sample.size() == 10);
+    REQUIRE(raman::From(sample).All([](long long i) { return i >= 0; }));
+    std::sort(sample.begin(), sample.end());
+    REQUIRE(std::unique(sample.begin(), sample.end()) == sample.end());
+  }
+
+  SECTION("SampleBy") {
+    vector<int> input = raman::Iota(0, 1000);
+    vector<vector<int>> samples = raman::From(input).SampleBy(
+        3, [](int i) { return i % 3; }, 5, rng);
+    REQUIRE(samples.size() == 3);
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      REQUIRE(samples[i].size() == 5);
+      for (int j : samples[i]) REQUIRE(j % 3 == static_cast<int>(i));
+    }
+    // Strata with fewer elements keep all of them.
+    samples = raman::From(vector<int>{1, 2, 4}).SampleBy(
+        2, [](int i) { return i % 2; }, 5, rng);
+    REQUIRE(samples == (vector<vector<int>>{{2, 4}, {1}}));
+  }
+}
+
+TEST_CASE("Cursor") {
+  vector<int> input = raman::Iota(0, 100);
+
+  SECTION("Pages without repeating work") {
+    int calls = 0;
+    auto cursor = raman::From(input)
+                      .Where([&calls](int i) {
+                        ++calls;
+                        return i % 2 == 0;
+                      })
+                      .Cursor();
+    // Nothing runs until the first page is taken.
+    REQUIRE(calls == 0);
+    REQUIRE(cursor.Next(3) == (vector<int>{0, 2, 4}));
+    // The cursor moved on to the next element, 6.
+    REQUIRE(calls == 7);
+    REQUIRE(cursor.Position() == 3);
+
+    // Cursors may be stored and moved between pages.
+    std::map<string, decltype(cursor)> cursors;
+    cursors.emplace("token", std::move(cursor));
+    REQUIRE(cursors.at("token").Next(2) == (vector<int>{6, 8}));
+    REQUIRE(calls == 11);
+
+    vector<int> rest = cursors.at("token").Next(1000);
+    REQUIRE(rest.size() == 45);
+    REQUIRE(rest.back() == 98);
+    REQUIRE(calls == 100);
+    REQUIRE(cursors.at("token").IsDone());
+    REQUIRE(cursors.at("token").Next(10).empty());
+    REQUIRE(cursors.at("token").Position() == 50);
+  }
+
+  SECTION("Sort() sorts once") {
+    int comparisons = 0;
+    auto cursor =
+        raman::From(input)
+            .Sort([&comparisons](int a, int b) {
+              ++comparisons;
+              return a > b;
+            })
+            .Cursor();
+    REQUIRE(!cursor.IsDone());
+    REQUIRE(cursor.Next(2) == (vector<int>{99, 98}));
+    int after_first_page = comparisons;
+    REQUIRE(cursor.Next(2) == (vector<int>{97, 96}));
+    REQUIRE(comparisons == after_first_page);
+  }
+
+  SECTION("Single-pass ranges") {
+    std::istringstream stream("1 2 3 4 5");
+    std::istream_iterator<int> begin(stream), end;
+    auto cursor = raman::From(begin, end).Cursor();
+    REQUIRE(cursor.Next(2) == (vector<int>{1, 2}));
+    REQUIRE(cursor.Next(2) == (vector<int>{3, 4}));
+    REQUIRE(cursor.Next(2) == (vector<int>{5}));
+    REQUIRE(cursor.IsDone());
+  }
+}
+
+#ifdef RAMAN_HAS_COROUTINES
+namespace {
+  raman::Generator<int> Range(int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      co_yield i;
+    }
+  }
+
+  raman::Generator<string> Words() {
+    co_yield "one";
+    co_yield "two";
+    co_yield "three";
+    throw std::runtime_error("no more words");
+  }
+}
+
+TEST_CASE("coroutine generator") {
+  {
+    vector<int> out = raman::From(Range(0, 6))
+                        .Where([](int i) { return i % 2 == 0; })
+                        .Transform([](int i) { return i * 10; });
+    REQUIRE(out == vector<int>{0, 20, 40});
+  }
+
+  {
+    vector<int> out = raman::From(Range(0, 0)).Reverse();
+    REQUIRE(out == vector<int>{});
+  }
+
+  {
+    vector<int> out = raman::From(Range(0, 4)).Reverse();
+    REQUIRE(out == vector<int>{3, 2, 1, 0});
+  }
+
+  {
+    vector<string> out;
+    for (const string& word : raman::From(Words())) {
+      out.push_back(word);
+      if (out.size() == 3) {
+        break;
+      }
+    }
+    REQUIRE(out == vector<string>{"one", "two", "three"});
+  }
+
+  {
+    auto consume = []() { vector<string> out = raman::From(Words()); };
+    REQUIRE_THROWS_AS(consume(), std::runtime_error);
+  }
+}
+#endif